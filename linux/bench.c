@@ -0,0 +1,870 @@
+/* Headless image generation benchmark for Acid Warp
+ *
+ * Times generate_image_float() for every image function without creating
+ * a window or an OpenGL context, so generation cost can be measured in
+ * isolation from palette rotation and texture uploads. Results are written
+ * to stdout as JSON.
+ *
+ * With -V, it instead draws every image function in both double and single
+ * precision and reports how many pixels get a different palette index.
+ * With -x, it times formulas loaded from a file against the built in
+ * functions they reproduce. With -a, it times live warp frames, where the
+ * parameters of every function move from frame to frame, and reports how
+ * many images per second can be regenerated. With -c, it checks the
+ * relative costs of generate_image_info() against measured times. With -F,
+ * it times drawing the index fractions used by acidwarp -f against drawing
+ * palette indices alone.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "handy.h"
+#include "acidwarp.h"
+#include "bit_map.h"
+#include "expr.h"
+#include "gen_pool.h"
+#include "img_float.h"
+#include "live.h"
+#include "rng.h"
+
+#define MAX_RESOLUTIONS 16
+
+/* Live warp frames timed by -a move on by this much, like frames shown at
+ * 30 frames per second.
+ */
+#define LIVE_FRAME_SECONDS (1.0 / 30)
+
+/* Normally owned by draw.c, which is not linked here */
+int abort_draw = 0;
+
+/* Generator timed. float is generate_image_float(), as used by draw.c
+ * with DRAW_FLOAT, which picks double or float32 for every function.
+ */
+enum { ENGINE_FLOAT, ENGINE_DOUBLE, ENGINE_FLOAT32, ENGINE_INT };
+static const char *engine_names[] = { "float", "double", "float32", "int" };
+static int engine = ENGINE_FLOAT;
+
+/* Pixels per sample. Above 1, times the coarse preview of draw.c */
+static UINT step = 1;
+
+struct resolution {
+  UINT width, height;
+};
+
+static const struct resolution default_resolutions[] = {
+  {  320,  200 },
+  { 1920, 1080 },
+  { 3840, 2160 },
+  { 7680, 4320 }
+};
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -r WxH[,WxH...]  resolutions (default 320x200,1920x1080,3840x2160,7680x4320)\n"
+          "  -f first[-last]  image functions (default 0-%d)\n"
+          "  -n reps          frames generated per measurement (default 3)\n"
+          "  -s mode          scaled, unscaled or both (default both)\n"
+          "  -t threads       generator threads (default one per logical CPU core)\n"
+          "  -e engine        image generator: float, double, float32 or int (default float)\n"
+          "  -S seed          random seed, so runs draw the same images (default 1)\n"
+          "  -p step          pixels per sample, 8 for the progressive preview (default 1)\n"
+          "  -k isa           force lut kernels: avx512, avx2, sse2 or scalar\n"
+          "  -K               time the lut kernels of every instruction set instead\n"
+          "  -V percent       compare double and float32 images instead, failing if a\n"
+          "                   function using float32 changes more pixels than this\n"
+          "  -x file          time formulas from file against the built in functions\n"
+          "                   they reproduce instead\n"
+          "  -a               time live warp frames instead, whose parameters move\n"
+          "                   from frame to frame, in regenerations per second\n"
+          "  -c factor        check the costs of generate_image_info() instead,\n"
+          "                   failing if a function takes more than factor times\n"
+          "                   longer or shorter than predicted\n"
+          "  -F               time drawing index fractions for smooth shading\n"
+          "                   instead, against drawing palette indices alone\n"
+          "  -B block         time adaptive refinement in blocks of block pixels\n"
+          "                   instead, against the exact images\n"
+          "  -l               also time the logo bitmap\n"
+          "  -h               print this help\n",
+          prog, NUM_IMAGE_FUNCTIONS - 1);
+}
+
+static double now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int parse_resolutions(char *arg, struct resolution *res)
+{
+  int count = 0;
+  char *tok;
+
+  for (tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+    if (count >= MAX_RESOLUTIONS ||
+        sscanf(tok, "%ux%u", &res[count].width, &res[count].height) != 2 ||
+        res[count].width == 0 || res[count].height == 0) {
+      return -1;
+    }
+    ++count;
+  }
+  return count;
+}
+
+#define KERNEL_VALUES 65536
+
+/* Times the scalar libm lut functions against the vector kernels of every
+ * instruction set this CPU supports, in millions of values per second.
+ */
+static void bench_kernels(int reps)
+{
+  static const char *isas[] = { "libm", "scalar", "sse2", "avx2", "avx512" };
+  static double in[KERNEL_VALUES], out[KERNEL_VALUES];
+  int i, k, rep, first_result = 1;
+
+  for (i = 0; i < KERNEL_VALUES; ++i) {
+    in[i] = (i - KERNEL_VALUES / 2) * 0.37;
+  }
+
+  printf("{\n  \"benchmark\": \"lut_kernels\",\n  \"results\": [");
+  for (k = 0; k < (int)(sizeof(isas) / sizeof(isas[0])); ++k) {
+    double ms[4], start;
+    int kernel;
+
+    if (k > 0 && !lut_simd_select(isas[k])) continue;
+
+    for (kernel = 0; kernel < 4; ++kernel) {
+      start = now_ms();
+      for (rep = 0; rep < reps * 16; ++rep) {
+        if (k == 0) {
+          for (i = 0; i < KERNEL_VALUES; ++i) {
+            switch (kernel) {
+              case 0: out[i] = lut_sin(in[i]); break;
+              case 1: out[i] = lut_cos(in[i]); break;
+              case 2: out[i] = lut_angle(in[i], 12.5); break;
+              default: out[i] = lut_dist(in[i], 12.5); break;
+            }
+          }
+        } else {
+          switch (kernel) {
+            case 0: lut_sin_v(in, out, KERNEL_VALUES); break;
+            case 1: lut_cos_v(in, out, KERNEL_VALUES); break;
+            case 2: lut_angle_v(in, 12.5, out, KERNEL_VALUES); break;
+            default: lut_dist_v(in, 12.5, out, KERNEL_VALUES); break;
+          }
+        }
+      }
+      ms[kernel] = now_ms() - start;
+    }
+
+    printf("%s\n    { \"isa\": \"%s\"", first_result ? "" : ",", isas[k]);
+    printf(", \"sin_mvalues_per_s\": %.1f", reps * 16.0 * KERNEL_VALUES / (ms[0] * 1000.0));
+    printf(", \"cos_mvalues_per_s\": %.1f", reps * 16.0 * KERNEL_VALUES / (ms[1] * 1000.0));
+    printf(", \"angle_mvalues_per_s\": %.1f", reps * 16.0 * KERNEL_VALUES / (ms[2] * 1000.0));
+    printf(", \"dist_mvalues_per_s\": %.1f }", reps * 16.0 * KERNEL_VALUES / (ms[3] * 1000.0));
+    first_result = 0;
+  }
+  printf("\n  ]\n}\n");
+}
+
+typedef void (*generate_func)(int, UCHAR *, UINT, UINT, UINT, UINT,
+                              UINT, UINT, UINT, UINT);
+
+static generate_func engine_generate(int how)
+{
+  switch (how) {
+    case ENGINE_DOUBLE: return generate_image_double;
+    case ENGINE_FLOAT32: return generate_image_float32;
+    case ENGINE_INT: return generate_image_int;
+    default: return generate_image_float;
+  }
+}
+
+static void draw_function(int func, UCHAR *buf, struct resolution res,
+                          int scaled, int how)
+{
+  engine_generate(how)(func, buf, res.width/2, res.height/2,
+                       res.width, res.height,
+                       256, res.width, scaled ? DRAW_SCALED : 0, step);
+}
+
+/* Returns milliseconds per frame, averaged over reps frames */
+static double time_function(int func, UCHAR *buf, struct resolution res,
+                            int scaled, int reps)
+{
+  double start;
+  int rep;
+
+  start = now_ms();
+  for (rep = 0; rep < reps; ++rep) {
+    if (func < 0) {
+      writeBitmapImageToArray(buf, res.width, res.height, res.width);
+    } else {
+      draw_function(func, buf, res, scaled, engine);
+    }
+  }
+  return (now_ms() - start) / reps;
+}
+
+static double differ_percent(const UCHAR *a, const UCHAR *b, size_t pixels)
+{
+  size_t i, differ = 0;
+
+  for (i = 0; i < pixels; ++i) {
+    if (a[i] != b[i]) ++differ;
+  }
+  return 100.0 * differ / pixels;
+}
+
+/* Times every loaded formula, and the built in function it reproduces in
+ * the same double precision engine. Both draw from the same seed, so the
+ * images should be the same.
+ */
+static void bench_formulas(const struct resolution *resolutions,
+                           int num_resolutions, int scaled_modes,
+                           UINT seed, int reps)
+{
+  int r, s, i, builtin, first_result = 1;
+
+  engine = ENGINE_DOUBLE;
+  printf("{\n  \"benchmark\": \"formulas\",\n  \"seed\": %u,\n"
+         "  \"step\": %u,\n  \"reps\": %d,\n  \"threads\": %d,\n"
+         "  \"simd\": \"%s\",\n  \"results\": [",
+         seed, step, reps, gen_pool_threads(), lut_simd_name());
+
+  for (r = 0; r < num_resolutions; ++r) {
+    struct resolution res = resolutions[r];
+    size_t pixels = (size_t)res.width * res.height;
+    UCHAR *ref = malloc(pixels), *buf = malloc(pixels);
+    if (ref == NULL || buf == NULL) {
+      fprintf(stderr, "Couldn't allocate %ux%u buffer\n", res.width, res.height);
+      exit(1);
+    }
+
+    for (s = 0; s < 2; ++s) {
+      if (!(scaled_modes & (1 << s))) continue;
+
+      /* Untimed frame, so per-resolution caches are built before timing */
+      rng_init(seed);
+      time_function(0, buf, res, s, 1);
+
+      for (i = 0; i < expr_count(); ++i) {
+        double ms, builtin_ms;
+
+        rng_init(seed);
+        ms = time_function(FIRST_FORMULA_FUNCTION + i, buf, res, s, reps);
+        printf("%s\n    { \"formula\": %d, \"width\": %u, \"height\": %u, "
+               "\"scaled\": %s, \"ms_per_frame\": %.3f",
+               first_result ? "" : ",", i, res.width, res.height,
+               s ? "true" : "false", ms);
+
+        builtin = expr_builtin(i);
+        if (builtin >= 0) {
+          rng_init(seed);
+          builtin_ms = time_function(builtin, ref, res, s, reps);
+          printf(", \"builtin\": %d, \"builtin_ms_per_frame\": %.3f, "
+                 "\"slowdown\": %.2f, \"differ_percent\": %.4f",
+                 builtin, builtin_ms, builtin_ms > 0.0 ? ms / builtin_ms : 0.0,
+                 differ_percent(ref, buf, pixels));
+        }
+        printf(" }");
+        fflush(stdout);
+        first_result = 0;
+      }
+    }
+    free(ref);
+    free(buf);
+  }
+
+  printf("\n  ]\n}\n");
+}
+
+/* Regenerates every function reps times while its parameters move, like
+ * acidwarp -a does, and prints the regenerations per second. Every
+ * resolution ends with the average and the slowest function.
+ */
+static void bench_live(const struct resolution *resolutions,
+                       int num_resolutions, int first_func, int last_func,
+                       int scaled_modes, UINT seed, int reps)
+{
+  generate_func generate = engine_generate(engine);
+  int r, s, func, rep, first_result = 1;
+
+  printf("{\n  \"benchmark\": \"live_warp\",\n"
+         "  \"engine\": \"%s\",\n  \"seed\": %u,\n  \"step\": %u,\n"
+         "  \"reps\": %d,\n  \"threads\": %d,\n  \"simd\": \"%s\",\n"
+         "  \"results\": [",
+         engine_names[engine], seed, step, reps, gen_pool_threads(), lut_simd_name());
+
+  for (r = 0; r < num_resolutions; ++r) {
+    struct resolution res = resolutions[r];
+    UCHAR *buf = calloc((size_t)res.width * res.height, 1);
+    if (buf == NULL) {
+      fprintf(stderr, "Couldn't allocate %ux%u buffer\n", res.width, res.height);
+      exit(1);
+    }
+
+    for (s = 0; s < 2; ++s) {
+      double total_ms = 0.0, slowest_ms = 0.0;
+
+      if (!(scaled_modes & (1 << s))) continue;
+
+      for (func = first_func; func <= last_func; ++func) {
+        struct live_warp live;
+        struct gen_warp warp;
+        UINT xcenter, ycenter;
+        double ms, start;
+
+        rng_init(seed);
+        live_begin(&live);
+        /* The centre moves, so the polar field is rebuilt for every frame,
+         * which is timed too.
+         */
+        start = now_ms();
+        for (rep = 0; rep < reps; ++rep) {
+          live_frame(&live, rep ? LIVE_FRAME_SECONDS : 0.0,
+                     res.width, res.height, &warp, &xcenter, &ycenter);
+          generate_set_warp(&warp);
+          generate(func, buf, xcenter, ycenter, res.width, res.height,
+                   256, res.width, s ? DRAW_SCALED : 0, step);
+        }
+        ms = (now_ms() - start) / reps;
+        generate_set_warp(NULL);
+        total_ms += ms;
+        if (ms > slowest_ms) slowest_ms = ms;
+
+        printf("%s\n    { \"function\": %d, \"width\": %u, \"height\": %u, "
+               "\"scaled\": %s, \"ms_per_frame\": %.3f, "
+               "\"regenerations_per_s\": %.1f }",
+               first_result ? "" : ",", func, res.width, res.height,
+               s ? "true" : "false", ms, ms > 0.0 ? 1000.0 / ms : 0.0);
+        fflush(stdout);
+        first_result = 0;
+      }
+
+      printf(",\n    { \"function\": \"all\", \"width\": %u, \"height\": %u, "
+             "\"scaled\": %s, \"regenerations_per_s\": %.1f, "
+             "\"slowest_regenerations_per_s\": %.1f }",
+             res.width, res.height, s ? "true" : "false",
+             total_ms > 0.0 ? 1000.0 * (last_func - first_func + 1) / total_ms : 0.0,
+             slowest_ms > 0.0 ? 1000.0 / slowest_ms : 0.0);
+      fflush(stdout);
+    }
+    free(buf);
+  }
+
+  printf("\n  ]\n}\n");
+}
+
+/* Times every function drawing palette indices alone, and also drawing
+ * their fractions like acidwarp -f does. Fractions double the bytes per
+ * pixel uploaded to the display, which is reported too.
+ */
+static void bench_smooth(const struct resolution *resolutions,
+                         int num_resolutions, int first_func, int last_func,
+                         int scaled_modes, UINT seed, int reps)
+{
+  int r, s, func, first_result = 1;
+
+  printf("{\n  \"benchmark\": \"smooth\",\n"
+         "  \"engine\": \"%s\",\n  \"seed\": %u,\n  \"step\": %u,\n"
+         "  \"reps\": %d,\n  \"threads\": %d,\n  \"simd\": \"%s\",\n"
+         "  \"results\": [",
+         engine_names[engine], seed, step, reps, gen_pool_threads(), lut_simd_name());
+
+  for (r = 0; r < num_resolutions; ++r) {
+    struct resolution res = resolutions[r];
+    size_t pixels = (size_t)res.width * res.height;
+    UCHAR *buf = calloc(pixels, 1), *frac = calloc(pixels, 1);
+    if (buf == NULL || frac == NULL) {
+      fprintf(stderr, "Couldn't allocate %ux%u buffer\n", res.width, res.height);
+      exit(1);
+    }
+
+    for (s = 0; s < 2; ++s) {
+      double total_ms = 0.0, total_smooth_ms = 0.0;
+
+      if (!(scaled_modes & (1 << s))) continue;
+
+      /* Untimed frame, so per-resolution caches are built before timing */
+      rng_init(seed);
+      time_function(first_func, buf, res, s, 1);
+
+      for (func = first_func; func <= last_func; ++func) {
+        double ms, smooth_ms;
+
+        rng_init(seed);
+        ms = time_function(func, buf, res, s, reps);
+        rng_init(seed);
+        generate_set_fraction(frac);
+        smooth_ms = time_function(func, buf, res, s, reps);
+        generate_set_fraction(NULL);
+        total_ms += ms;
+        total_smooth_ms += smooth_ms;
+
+        printf("%s\n    { \"function\": %d, \"width\": %u, \"height\": %u, "
+               "\"scaled\": %s, \"ms_per_frame\": %.3f, "
+               "\"smooth_ms_per_frame\": %.3f, \"overhead_percent\": %.1f }",
+               first_result ? "" : ",", func, res.width, res.height,
+               s ? "true" : "false", ms, smooth_ms,
+               ms > 0.0 ? 100.0 * (smooth_ms - ms) / ms : 0.0);
+        fflush(stdout);
+        first_result = 0;
+      }
+
+      printf(",\n    { \"function\": \"all\", \"width\": %u, \"height\": %u, "
+             "\"scaled\": %s, \"overhead_percent\": %.1f, "
+             "\"upload_bytes\": %zu, \"smooth_upload_bytes\": %zu }",
+             res.width, res.height, s ? "true" : "false",
+             total_ms > 0.0 ? 100.0 * (total_smooth_ms - total_ms) / total_ms : 0.0,
+             pixels, 2 * pixels);
+      fflush(stdout);
+    }
+    free(buf);
+    free(frac);
+  }
+
+  printf("\n  ]\n}\n");
+}
+
+/* Times every function drawn exactly and by adaptive refinement in blocks
+ * of block pixels, and reports the part of the pixels adaptive refinement
+ * evaluated, and the part which got a different palette index. Functions
+ * which are not marked as allowing it are refined too, to measure them as
+ * candidates, except those reading neighbouring pixels, which are drawn
+ * exactly both times.
+ */
+static void bench_adaptive(const struct resolution *resolutions,
+                           int num_resolutions, int first_func, int last_func,
+                           int scaled_modes, UINT seed, int reps, UINT block)
+{
+  int r, s, func, first_result = 1;
+
+  printf("{\n  \"benchmark\": \"adaptive\",\n"
+         "  \"engine\": \"%s\",\n  \"seed\": %u,\n  \"block\": %u,\n"
+         "  \"reps\": %d,\n  \"threads\": %d,\n  \"simd\": \"%s\",\n"
+         "  \"results\": [",
+         engine_names[engine], seed, block, reps, gen_pool_threads(), lut_simd_name());
+
+  for (r = 0; r < num_resolutions; ++r) {
+    struct resolution res = resolutions[r];
+    size_t pixels = (size_t)res.width * res.height;
+    UCHAR *ref = malloc(pixels), *buf = malloc(pixels);
+    if (ref == NULL || buf == NULL) {
+      fprintf(stderr, "Couldn't allocate %ux%u buffer\n", res.width, res.height);
+      exit(1);
+    }
+
+    for (s = 0; s < 2; ++s) {
+      if (!(scaled_modes & (1 << s))) continue;
+
+      /* Untimed frame, so per-resolution caches are built before timing */
+      rng_init(seed);
+      time_function(first_func, buf, res, s, 1);
+
+      for (func = first_func; func <= last_func; ++func) {
+        struct gen_info info;
+        double ms, adaptive_ms, evaluated, differ;
+
+        rng_init(seed);
+        draw_function(func, ref, res, s, engine);
+        rng_init(seed);
+        generate_set_adaptive(block, 1);
+        draw_function(func, buf, res, s, engine);
+        evaluated = generate_evaluated();
+        differ = differ_percent(ref, buf, pixels);
+
+        rng_init(seed);
+        adaptive_ms = time_function(func, buf, res, s, reps);
+        generate_set_adaptive(0, 0);
+        rng_init(seed);
+        ms = time_function(func, buf, res, s, reps);
+        generate_image_info(func, &info);
+
+        printf("%s\n    { \"function\": %d, \"width\": %u, \"height\": %u, "
+               "\"scaled\": %s, \"adaptive\": %s, \"ms_per_frame\": %.3f, "
+               "\"adaptive_ms_per_frame\": %.3f, \"evaluated_percent\": %.1f, "
+               "\"differ_percent\": %.4f }",
+               first_result ? "" : ",", func, res.width, res.height,
+               s ? "true" : "false",
+               (info.flags & GEN_INFO_ADAPTIVE) ? "true" : "false",
+               ms, adaptive_ms, 100.0 * evaluated, differ);
+        fflush(stdout);
+        first_result = 0;
+      }
+    }
+    free(ref);
+    free(buf);
+  }
+
+  printf("\n  ]\n}\n");
+}
+
+/* Times every function, and compares it with the time predicted from its
+ * cost. The time per pixel and cost unit is fitted to all measurements, so
+ * only relative costs are checked. Returns 0 if a function takes more than
+ * factor times longer or shorter than predicted.
+ */
+static int verify_costs(const struct resolution *resolutions,
+                        int num_resolutions, int first_func, int last_func,
+                        int scaled_modes, UINT seed, int reps, double factor)
+{
+  int funcs = last_func - first_func + 1;
+  double *ms = malloc((size_t)num_resolutions * 2 * funcs * sizeof(double));
+  double log_sum = 0.0, ns_per_cost;
+  int r, s, func, n = 0, first_result = 1, passed = 1;
+  struct gen_info info;
+
+  if (ms == NULL) {
+    fprintf(stderr, "Couldn't allocate timings\n");
+    exit(1);
+  }
+
+  /* Their cost is that of the noise drawn instead */
+  for (func = first_func; func <= last_func; ++func) {
+    generate_image_info(func, &info);
+    if (info.flags & GEN_INFO_UNKNOWN) {
+      fprintf(stderr, "No function %d to check\n", func);
+      free(ms);
+      return 0;
+    }
+  }
+
+  for (r = 0; r < num_resolutions; ++r) {
+    struct resolution res = resolutions[r];
+    double pixels = (double)res.width * res.height;
+    UCHAR *buf = calloc((size_t)res.width * res.height, 1);
+    if (buf == NULL) {
+      fprintf(stderr, "Couldn't allocate %ux%u buffer\n", res.width, res.height);
+      exit(1);
+    }
+
+    for (s = 0; s < 2; ++s) {
+      if (!(scaled_modes & (1 << s))) continue;
+
+      rng_init(seed);
+      time_function(first_func, buf, res, s, 1);
+      for (func = first_func; func <= last_func; ++func) {
+        double *t = &ms[(r * 2 + s) * funcs + func - first_func];
+
+        rng_init(seed);
+        *t = time_function(func, buf, res, s, reps);
+        generate_image_info(func, &info);
+        /* Geometric mean, so every function counts the same */
+        log_sum += log(*t * 1000000.0 / (info.cost * pixels));
+        ++n;
+      }
+    }
+    free(buf);
+  }
+  ns_per_cost = n > 0 ? exp(log_sum / n) : 0.0;
+
+  printf("{\n  \"benchmark\": \"costs\",\n  \"engine\": \"%s\",\n"
+         "  \"seed\": %u,\n  \"reps\": %d,\n  \"threads\": %d,\n"
+         "  \"factor\": %g,\n  \"ns_per_cost\": %.3f,\n  \"results\": [",
+         engine_names[engine], seed, reps, gen_pool_threads(), factor,
+         ns_per_cost);
+
+  for (r = 0; r < num_resolutions; ++r) {
+    struct resolution res = resolutions[r];
+    double pixels = (double)res.width * res.height;
+
+    for (s = 0; s < 2; ++s) {
+      if (!(scaled_modes & (1 << s))) continue;
+
+      for (func = first_func; func <= last_func; ++func) {
+        double t = ms[(r * 2 + s) * funcs + func - first_func];
+        double predicted, ratio;
+        int pass;
+
+        generate_image_info(func, &info);
+        predicted = info.cost * ns_per_cost * pixels / 1000000.0;
+        ratio = predicted > 0.0 ? t / predicted : 0.0;
+        pass = ratio <= factor && ratio * factor >= 1.0;
+        if (!pass) passed = 0;
+
+        printf("%s\n    { \"function\": %d, \"width\": %u, \"height\": %u, "
+               "\"scaled\": %s, \"cost\": %u, \"ms_per_frame\": %.3f, "
+               "\"predicted_ms\": %.3f, \"ratio\": %.2f, \"pass\": %s }",
+               first_result ? "" : ",", func, res.width, res.height,
+               s ? "true" : "false", info.cost, t, predicted, ratio,
+               pass ? "true" : "false");
+        first_result = 0;
+      }
+    }
+  }
+
+  printf("\n  ]\n}\n");
+  free(ms);
+  return passed;
+}
+
+/* Draws every function in double and single precision from the same seed,
+ * and prints the percentage of pixels with a different palette index.
+ * Returns 0 if a function which generate_image_float() draws in single
+ * precision differs by more than max_percent.
+ */
+static int verify_single(const struct resolution *resolutions,
+                         int num_resolutions, int first_func, int last_func,
+                         int scaled_modes, UINT seed, double max_percent)
+{
+  int r, s, func, first_result = 1, passed = 1;
+
+  printf("{\n  \"benchmark\": \"float32_accuracy\",\n  \"seed\": %u,\n"
+         "  \"step\": %u,\n  \"max_percent\": %g,\n  \"results\": [",
+         seed, step, max_percent);
+
+  for (r = 0; r < num_resolutions; ++r) {
+    struct resolution res = resolutions[r];
+    size_t pixels = (size_t)res.width * res.height;
+    UCHAR *ref = malloc(pixels), *buf = malloc(pixels);
+    if (ref == NULL || buf == NULL) {
+      fprintf(stderr, "Couldn't allocate %ux%u buffer\n", res.width, res.height);
+      exit(1);
+    }
+
+    for (s = 0; s < 2; ++s) {
+      if (!(scaled_modes & (1 << s))) continue;
+
+      for (func = first_func; func <= last_func; ++func) {
+        double percent;
+        int single = generate_image_single(func);
+        int pass;
+
+        rng_init(seed);
+        draw_function(func, ref, res, s, ENGINE_DOUBLE);
+        rng_init(seed);
+        draw_function(func, buf, res, s, ENGINE_FLOAT32);
+        percent = differ_percent(ref, buf, pixels);
+        pass = percent <= max_percent;
+        if (single && !pass) passed = 0;
+
+        printf("%s\n    { \"function\": %d, \"width\": %u, \"height\": %u, "
+               "\"scaled\": %s, \"differ_percent\": %.4f, \"pass\": %s, "
+               "\"float32\": %s }",
+               first_result ? "" : ",", func, res.width, res.height,
+               s ? "true" : "false", percent, pass ? "true" : "false",
+               single ? "true" : "false");
+        fflush(stdout);
+        first_result = 0;
+      }
+    }
+    free(ref);
+    free(buf);
+  }
+
+  printf("\n  ]\n}\n");
+  return passed;
+}
+
+int main(int argc, char *argv[])
+{
+  struct resolution resolutions[MAX_RESOLUTIONS];
+  int num_resolutions = sizeof(default_resolutions) / sizeof(default_resolutions[0]);
+  int first_func = 0, last_func = NUM_IMAGE_FUNCTIONS - 1;
+  int reps = 3;
+  int scaled_modes = 3; /* bit 0: unscaled, bit 1: scaled */
+  int logo = 0;
+  int threads = 0;
+  int kernels = 0;
+  double verify = -1.0;
+  const char *formulas = NULL;
+  int live = 0;
+  int smooth = 0;
+  UINT adaptive = 0;
+  double cost_factor = 0.0;
+  UINT seed = 1;
+  int argNum, r, s, func, first_result = 1;
+
+  memcpy(resolutions, default_resolutions, sizeof(default_resolutions));
+
+  for (argNum = 1; argNum < argc; ++argNum) {
+    if (!strcmp("-r", argv[argNum]) && argNum + 1 < argc) {
+      num_resolutions = parse_resolutions(argv[++argNum], resolutions);
+      if (num_resolutions <= 0) {
+        fprintf(stderr, "Invalid resolution list\n");
+        return 1;
+      }
+    } else if (!strcmp("-f", argv[argNum]) && argNum + 1 < argc) {
+      switch (sscanf(argv[++argNum], "%d-%d", &first_func, &last_func)) {
+        case 1: last_func = first_func; break;
+        case 2: break;
+        default: first_func = -1; break;
+      }
+      /* Other numbers would time the fallback for unknown functions */
+      if (first_func < 0 || first_func > last_func ||
+          last_func >= NUM_IMAGE_FUNCTIONS) {
+        fprintf(stderr, "Invalid function range, functions are 0-%d\n",
+                NUM_IMAGE_FUNCTIONS - 1);
+        return 1;
+      }
+    } else if (!strcmp("-n", argv[argNum]) && argNum + 1 < argc) {
+      reps = atoi(argv[++argNum]);
+      if (reps < 1) reps = 1;
+    } else if (!strcmp("-s", argv[argNum]) && argNum + 1 < argc) {
+      ++argNum;
+      if (!strcmp("scaled", argv[argNum])) scaled_modes = 2;
+      else if (!strcmp("unscaled", argv[argNum])) scaled_modes = 1;
+      else if (!strcmp("both", argv[argNum])) scaled_modes = 3;
+      else {
+        fprintf(stderr, "Invalid scaling mode\n");
+        return 1;
+      }
+    } else if (!strcmp("-t", argv[argNum]) && argNum + 1 < argc) {
+      threads = atoi(argv[++argNum]);
+    } else if (!strcmp("-e", argv[argNum]) && argNum + 1 < argc) {
+      ++argNum;
+      for (engine = ENGINE_INT; engine >= 0; --engine) {
+        if (!strcmp(engine_names[engine], argv[argNum])) break;
+      }
+      if (engine < 0) {
+        fprintf(stderr, "Invalid engine\n");
+        return 1;
+      }
+    } else if (!strcmp("-S", argv[argNum]) && argNum + 1 < argc) {
+      seed = (UINT)strtoul(argv[++argNum], NULL, 0);
+    } else if (!strcmp("-p", argv[argNum]) && argNum + 1 < argc) {
+      step = (UINT)atoi(argv[++argNum]);
+      if (step < 1) step = 1;
+    } else if (!strcmp("-k", argv[argNum]) && argNum + 1 < argc) {
+      if (!lut_simd_select(argv[++argNum])) {
+        fprintf(stderr, "Instruction set %s is not supported\n", argv[argNum]);
+        return 1;
+      }
+    } else if (!strcmp("-K", argv[argNum])) {
+      kernels = 1;
+    } else if (!strcmp("-V", argv[argNum]) && argNum + 1 < argc) {
+      verify = atof(argv[++argNum]);
+      if (verify < 0.0) {
+        fprintf(stderr, "Invalid percentage\n");
+        return 1;
+      }
+    } else if (!strcmp("-x", argv[argNum]) && argNum + 1 < argc) {
+      formulas = argv[++argNum];
+    } else if (!strcmp("-c", argv[argNum]) && argNum + 1 < argc) {
+      cost_factor = atof(argv[++argNum]);
+      if (cost_factor < 1.0) {
+        fprintf(stderr, "Invalid factor\n");
+        return 1;
+      }
+    } else if (!strcmp("-a", argv[argNum])) {
+      live = 1;
+    } else if (!strcmp("-F", argv[argNum])) {
+      smooth = 1;
+    } else if (!strcmp("-B", argv[argNum]) && argNum + 1 < argc) {
+      adaptive = (UINT)atoi(argv[++argNum]);
+      if (adaptive < 2) {
+        fprintf(stderr, "Invalid block size\n");
+        return 1;
+      }
+    } else if (!strcmp("-l", argv[argNum])) {
+      logo = 1;
+    } else {
+      usage(argv[0]);
+      return strcmp("-h", argv[argNum]) ? 1 : 0;
+    }
+  }
+
+  if (kernels) {
+    bench_kernels(reps);
+    return 0;
+  }
+
+  gen_pool_init(threads);
+
+  if (formulas != NULL) {
+    if (expr_load(formulas) <= 0) {
+      fprintf(stderr, "No formulas loaded from %s\n", formulas);
+      return 1;
+    }
+    bench_formulas(resolutions, num_resolutions, scaled_modes, seed, reps);
+    return 0;
+  }
+
+  if (cost_factor > 0.0) {
+    return verify_costs(resolutions, num_resolutions, first_func, last_func,
+                        scaled_modes, seed, reps, cost_factor) ? 0 : 1;
+  }
+
+  if (live) {
+    bench_live(resolutions, num_resolutions, first_func, last_func,
+               scaled_modes, seed, reps);
+    return 0;
+  }
+
+  if (smooth) {
+    bench_smooth(resolutions, num_resolutions, first_func, last_func,
+                 scaled_modes, seed, reps);
+    return 0;
+  }
+
+  if (adaptive > 0) {
+    bench_adaptive(resolutions, num_resolutions, first_func, last_func,
+                   scaled_modes, seed, reps, adaptive);
+    return 0;
+  }
+
+  if (verify >= 0.0) {
+    return verify_single(resolutions, num_resolutions, first_func, last_func,
+                         scaled_modes, seed, verify) ? 0 : 1;
+  }
+
+  printf("{\n  \"benchmark\": \"generate_image_float\",\n"
+         "  \"engine\": \"%s\",\n  \"seed\": %u,\n  \"step\": %u,\n"
+         "  \"reps\": %d,\n  \"threads\": %d,\n  \"simd\": \"%s\",\n"
+         "  \"results\": [",
+         engine_names[engine], seed, step, reps, gen_pool_threads(), lut_simd_name());
+
+  for (r = 0; r < num_resolutions; ++r) {
+    struct resolution res = resolutions[r];
+    UCHAR *buf = calloc((size_t)res.width * res.height, 1);
+    if (buf == NULL) {
+      fprintf(stderr, "Couldn't allocate %ux%u buffer\n", res.width, res.height);
+      return 1;
+    }
+
+    for (s = 0; s < 2; ++s) {
+      if (!(scaled_modes & (1 << s))) continue;
+
+      /* Untimed frame, so per-resolution caches are built before timing */
+      rng_init(seed);
+      time_function(first_func, buf, res, s, 1);
+
+      for (func = logo ? -1 : first_func; func <= last_func; ++func) {
+        char name[16];
+        double ms;
+
+        if (func < 0) {
+          /* The logo does not depend on scaling, so only time it once */
+          if (s == 1 && (scaled_modes & 1)) continue;
+          strcpy(name, "\"logo\"");
+        } else if (func < first_func) {
+          continue;
+        } else {
+          sprintf(name, "%d", func);
+        }
+
+        /* Every measurement draws the same images, whatever else is run */
+        rng_init(seed);
+        ms = time_function(func, buf, res, s, reps);
+        printf("%s\n    { \"function\": %s, \"width\": %u, \"height\": %u, "
+               "\"scaled\": %s, \"ms_per_frame\": %.3f, \"mpixel_per_s\": %.2f }",
+               first_result ? "" : ",", name,
+               res.width, res.height, s ? "true" : "false", ms,
+               ms > 0.0 ? (double)res.width * res.height / (ms * 1000.0) : 0.0);
+        fflush(stdout);
+        first_result = 0;
+      }
+    }
+    free(buf);
+  }
+
+  printf("\n  ]\n}\n");
+  return 0;
+}
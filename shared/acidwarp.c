@@ -38,6 +38,10 @@ static inline int SDL_UnlockMutex_compat(SDL_Mutex *mutex) {
 #include "acidwarp.h"
 #include "rolnfade.h"
 #include "display.h"
+#include "expr.h"
+#include "gen_pool.h"
+#include "live.h"
+#include "rng.h"
 #include "AboutMenu.h"
 
 #define LOGO_TIME           10
@@ -50,15 +54,32 @@ static int image_time = LOGO_TIME;
 static int disp_flags = 0;
 static int draw_flags = DRAW_FLOAT | DRAW_SCALED;
 static int width = 1280, height = 800;
+static float render_scale = 1.0f; /* image size relative to window size */
+static int render_scale_set = FALSE; /* otherwise depends on live warp */
+static int smooth = FALSE; /* shade between palette entries */
+static int gen_threads = 0; /* 0 means one per logical CPU core */
+/* Part of the time an image is shown which drawing the next may take,
+ * before the quality governor draws it smaller. 0 turns it off.
+ */
+static float governor = 0.5f;
+/* Milliseconds of drawing per palette tick on the main thread, instead of
+ * drawing on another thread. 0 turns it off.
+ */
+static double slice_ms = 0.0;
+static UINT random_seed;
+static int random_seed_set = FALSE; /* otherwise seeded from the time */
 static int GO = TRUE;
 static int SKIP = FALSE;
 static int NP = FALSE; /* flag indicates new palette */
 static int LOCK = FALSE; /* flag indicates don't change to next image */
 static int RESIZE = FALSE;
+static int EXPLORE = FALSE; /* flag indicates explorer mode */
+static int EXPLORE_CHANGED = FALSE;
 static int QUIT_MAIN_LOOP = FALSE;
 
 /* Prototypes for forward referenced functions */
 static void mainLoop(void);
+static void commandline(int argc, char *argv[]);
 
 bool HandleAppEvents(void *userdata, SDL_Event *event)
 {
@@ -102,7 +123,7 @@ void makeShuffledList(int *list, int listSize)
   for (entryNum = 0; entryNum < listSize; ++entryNum)
     {
       do
-        r = RANDOM(listSize);
+        r = rng_below(&rng_draw, listSize);
       while (list[r] != -1);
 
       list[r] = entryNum;
@@ -190,6 +211,8 @@ int main (int argc, char *argv[])
   printf("[INIT] Acid Warp starting...\n");
   fflush(stdout);
 
+  commandline(argc, argv);
+
   /* Initialize SDL */
   printf("[INIT] Initializing SDL...\n");
   fflush(stdout);
@@ -213,10 +236,25 @@ int main (int argc, char *argv[])
 
   SDL_SetEventFilter(HandleAppEvents, NULL);
 
-  RANDOMIZE();
+  /* Everything random comes from this seed, so giving the same seed
+   * repeats the same sequence of patterns and palettes.
+   */
+  if (!random_seed_set) {
+    random_seed = (UINT)time(NULL);
+  }
+  rng_init(random_seed);
+  printf("[INIT] Random seed %u\n", random_seed);
+
+  printf("[INIT] Starting generator threads...\n");
+  fflush(stdout);
+  gen_pool_init(gen_threads);
+  printf("[INIT] Generating images with %d thread(s)\n", gen_pool_threads());
+  fflush(stdout);
 
   printf("[INIT] Initializing display...\n");
   fflush(stdout);
+  disp_setRenderScale(render_scale);
+  disp_setSmooth(smooth);
   disp_init(width, height, disp_flags);
   printf("[INIT] Display initialized\n");
   fflush(stdout);
@@ -242,6 +280,66 @@ int main (int argc, char *argv[])
   return 0;
 }
 
+/* Unknown arguments are ignored, because some platforms pass their own */
+static void commandline(int argc, char *argv[])
+{
+  int argNum;
+
+  for (argNum = 1; argNum < argc; ++argNum) {
+    if (!strcmp("-t", argv[argNum]) && argNum + 1 < argc) {
+      gen_threads = atoi(argv[++argNum]);
+    } else if (!strcmp("-S", argv[argNum]) && argNum + 1 < argc) {
+      random_seed = (UINT)strtoul(argv[++argNum], NULL, 0);
+      random_seed_set = TRUE;
+    } else if (!strcmp("-r", argv[argNum]) && argNum + 1 < argc) {
+      ++argNum;
+      render_scale = strcmp("pixel", argv[argNum]) ?
+                     (float)atof(argv[argNum]) : DISP_SCALE_PIXELS;
+      render_scale_set = TRUE;
+    } else if (!strcmp("-g", argv[argNum]) && argNum + 1 < argc) {
+      governor = (float)atof(argv[++argNum]);
+      if (governor < 0.0f) governor = 0.0f;
+    } else if (!strcmp("-T", argv[argNum]) && argNum + 1 < argc) {
+      slice_ms = atof(argv[++argNum]);
+      if (slice_ms < 0.0) slice_ms = 0.0;
+    } else if (!strcmp("-b", argv[argNum]) && argNum + 1 < argc) {
+      generate_set_adaptive((UINT)atoi(argv[++argNum]), 0);
+    } else if (!strcmp("-f", argv[argNum])) {
+      smooth = TRUE;
+    } else if (!strcmp("-a", argv[argNum])) {
+      draw_flags |= DRAW_LIVE;
+    } else if (!strcmp("-x", argv[argNum]) && argNum + 1 < argc) {
+      int count = expr_load(argv[++argNum]);
+      if (count >= 0) {
+        printf("[INIT] Loaded %d formula(s) from %s\n", count, argv[argNum]);
+      }
+    } else if (!strcmp("-i", argv[argNum])) {
+      draw_flags = (draw_flags & ~DRAW_FLOAT) | DRAW_INT;
+    }
+  }
+
+  /* Images drawn in time slices share the main thread, so other threads
+   * would only compete with it.
+   */
+  if (slice_ms > 0.0 && gen_threads == 0) {
+    gen_threads = 1;
+  }
+
+  /* Live warp draws many frames per image, so smaller ones by default */
+  if ((draw_flags & DRAW_LIVE) && !render_scale_set) {
+    render_scale = LIVE_RENDER_SCALE;
+  }
+}
+
+/* Part of the time which drawing gets. Drawing in time slices only gets
+ * one slice per palette tick.
+ */
+static double slice_share(void)
+{
+  if (slice_ms <= 0.0) return 1.0;
+  return MIN(slice_ms / MAX(TIMER_INTERVAL, 1), 1.0);
+}
+
 static void mainLoop(void)
 {
   static time_t ltime, mtime;
@@ -253,6 +351,9 @@ static void mainLoop(void)
   } state = STATE_INITIAL;
 
   disp_processInput();
+  if (state != STATE_INITIAL) {
+    draw_poll();
+  }
 
   if (RESIZE) {
     RESIZE = FALSE;
@@ -262,6 +363,13 @@ static void mainLoop(void)
     }
   }
 
+  if (EXPLORE_CHANGED) {
+    EXPLORE_CHANGED = FALSE;
+    /* Only images fully shown can be explored, not the logo */
+    if (state != STATE_DISPLAY || show_logo) EXPLORE = FALSE;
+    draw_explore(EXPLORE);
+  }
+
   if (SKIP) {
     if (state != STATE_DISPLAY) {
       SKIP = FALSE;
@@ -277,16 +385,32 @@ static void mainLoop(void)
   case STATE_INITIAL:
     printf("[INIT] Initializing drawing system\n");
     fflush(stdout);
+    draw_set_slice(slice_ms);
     draw_init(draw_flags | (show_logo ? DRAW_LOGO : 0));
     initRolNFade(show_logo);
     printf("[INIT] Drawing system initialized, starting pattern display\n");
     fflush(stdout);
+    state = STATE_NEXT;
 
     /* Fall through */
   case STATE_NEXT:
+    /* Images drawn in time slices are waited for by the main loop, which
+     * draws a slice each time round in draw_poll() and keeps handling input
+     */
+    if (!draw_ready()) break;
+
     /* install a new image */
     draw_next();
 
+    /* The next image, or in live warp mode the next frame, is drawn
+     * while this one is shown.
+     */
+    if (draw_flags & DRAW_LIVE) {
+      draw_set_budget(governor * MAX(TIMER_INTERVAL, 1) * slice_share());
+    } else {
+      draw_set_budget(governor * image_time * 1000.0 * slice_share());
+    }
+
     if (!show_logo) {
       newPalette();
     }
@@ -299,13 +423,20 @@ static void mainLoop(void)
     /* rotate the palette for a while */
     if(GO) {
       fadeInAndRotate();
+      draw_live();
     }
 
-    if(SKIP || (time(NULL) > mtime && !LOCK)) {
+    if(SKIP || (time(NULL) > mtime && !LOCK && !EXPLORE)) {
+      /* Skipping leaves the explorer */
+      if (EXPLORE) {
+        EXPLORE = FALSE;
+        draw_explore(EXPLORE);
+      }
       /* Transition from logo only fades to black,
        * like the first transition in Acidwarp 4.10.
        */
       beginFadeOut(show_logo);
+      draw_prepare();
       state = STATE_FADEOUT;
     }
     break;
@@ -313,6 +444,7 @@ static void mainLoop(void)
   case STATE_FADEOUT:
     /* fade out */
     if(GO) {
+      draw_live();
       if (fadeOut()) {
         show_logo = 0;
         image_time = PATTERN_TIME;
@@ -356,5 +488,10 @@ void handleinput(enum acidwarp_command cmd)
     case CMD_RESIZE:
       RESIZE = TRUE;
       break;
+    case CMD_EXPLORE:
+      if (EXPLORE) EXPLORE = FALSE;
+      else EXPLORE = TRUE;
+      EXPLORE_CHANGED = TRUE;
+      break;
     }
 }
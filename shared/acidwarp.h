@@ -20,6 +20,8 @@
 #define NUM_PALETTE_TYPES       8
 
 #define NUM_IMAGE_FUNCTIONS    41
+/* Formulas loaded with -x are image functions from this number onwards */
+#define FIRST_FORMULA_FUNCTION 64
 
 enum acidwarp_command {
   CMD_PAUSE = 1,
@@ -29,11 +31,16 @@ enum acidwarp_command {
   CMD_LOCK,
   CMD_PAL_FASTER,
   CMD_PAL_SLOWER,
-  CMD_RESIZE
+  CMD_RESIZE,
+  CMD_EXPLORE
 };
 
 void handleinput(enum acidwarp_command cmd);
 
+/* Draws image function imageFuncNum. With step > 1, only every step-th
+ * pixel in both directions is evaluated, and fills a step x step block,
+ * which gives a quick coarse preview.
+ */
 void generate_image_float(int imageFuncNum,
                           UCHAR *buf_graf,
                           UINT xcenter,
@@ -42,7 +49,175 @@ void generate_image_float(int imageFuncNum,
                           UINT height,
                           UINT colors,
                           UINT pitch,
-                          UINT normalize);
+                          UINT normalize,
+                          UINT step);
+
+/* Same as generate_image_float(), but always in double or single precision.
+ * generate_image_float() picks one of these for every function.
+ */
+void generate_image_double(int imageFuncNum,
+                           UCHAR *buf_graf,
+                           UINT xcenter,
+                           UINT ycenter,
+                           UINT width,
+                           UINT height,
+                           UINT colors,
+                           UINT pitch,
+                           UINT normalize,
+                           UINT step);
+void generate_image_float32(int imageFuncNum,
+                            UCHAR *buf_graf,
+                            UINT xcenter,
+                            UINT ycenter,
+                            UINT width,
+                            UINT height,
+                            UINT colors,
+                            UINT pitch,
+                            UINT normalize,
+                            UINT step);
+/* Returns 1 if generate_image_float() uses single precision for this function */
+int generate_image_single(int imageFuncNum);
+
+/* What is known about an image function, for scheduling it */
+struct gen_info {
+  /* Relative time per pixel. Multiplied by the pixels, it is roughly
+   * proportional to the time generate_image_float() takes.
+   */
+  UINT cost;
+  UINT flags;                   /* GEN_INFO_* */
+};
+
+#define GEN_INFO_MIRROR_X 1     /* left and right are mirror images */
+#define GEN_INFO_MIRROR_Y 2     /* top and bottom are mirror images */
+#define GEN_INFO_RANDOM 4       /* draws random numbers for every pixel */
+#define GEN_INFO_NEIGHBOUR 8    /* pixels depend on those left and above */
+#define GEN_INFO_SINGLE 16      /* generate_image_float() uses float32 */
+#define GEN_INFO_FORMULA 32     /* loaded with -x */
+#define GEN_INFO_ADAPTIVE 64    /* may be drawn by adaptive refinement */
+#define GEN_INFO_UNKNOWN 128    /* no such function, drawn as noise */
+
+void generate_image_info(int imageFuncNum, struct gen_info *info);
+
+/* Parameters of an image which the generate_image_*() functions otherwise
+ * take from rng_draw. Live warp mode moves them a little for every frame,
+ * so the image itself moves.
+ */
+struct gen_warp {
+  double offsets[8];            /* x1..x4, y1..y4 */
+  UINT seed;                    /* for functions drawing random pixels */
+};
+
+/* Makes the generate_image_*() functions use warp instead of new random
+ * parameters, until called again with NULL. warp must stay valid until then.
+ */
+void generate_set_warp(const struct gen_warp *warp);
+/* Returns the parameters for the next image, from the warp if one is set */
+void generate_params(struct gen_warp *params);
+
+/* Magnification and position of images, for explorer mode */
+struct gen_view {
+  double zoom;                  /* 1 is normal, larger magnifies */
+  double x, y;                  /* shown at the image centre, relative to
+                                   the centre of the image function */
+};
+
+/* Makes the floating point generate_image_*() functions draw this view,
+ * until called again with NULL, which is the normal view.
+ */
+void generate_set_view(const struct gen_view *view);
+
+/* Makes the floating point generate_image_*() functions also write how far
+ * the colour of every pixel is from its palette index towards the next,
+ * in 1/256 of an index, to frac, with the same pitch as the image. Stops
+ * when called again with NULL.
+ */
+void generate_set_fraction(UCHAR *frac);
+
+/* Makes the floating point generate_image_*() functions draw functions
+ * which allow it by adaptive refinement. Only every block-th row is
+ * evaluated, and the blocks of block x block pixels between them where the
+ * color changes by more than one palette index. Other pixels are
+ * interpolated, so a few differ from the exact image. 0 turns it off.
+ * With all set, every function but those reading neighbouring pixels is
+ * drawn this way, so candidates can be measured before they are marked.
+ */
+void generate_set_adaptive(UINT block, int all);
+/* Part of the pixels the last image evaluated, of those it would evaluate
+ * without adaptive refinement
+ */
+double generate_evaluated(void);
+
+/* Same as generate_image_float(), but using fixed point math */
+void generate_image_int(int imageFuncNum,
+                        UCHAR *buf_graf,
+                        UINT xcenter,
+                        UINT ycenter,
+                        UINT width,
+                        UINT height,
+                        UINT colors,
+                        UINT pitch,
+                        UINT normalize,
+                        UINT step);
+
+/* An image drawn a few rows at a time, so drawing it can be interleaved
+ * with other work on the same thread
+ */
+struct gen_job;
+
+/* Same as the generate_image_*() functions, but only set up the image and
+ * return a job, which generate_job_run() then draws. The parameters set by
+ * generate_set_*() are taken now. No other image may be drawn until the
+ * job is freed. Returns NULL if memory could not be allocated.
+ */
+struct gen_job *generate_job_float(int imageFuncNum,
+                                   UCHAR *buf_graf,
+                                   UINT xcenter,
+                                   UINT ycenter,
+                                   UINT width,
+                                   UINT height,
+                                   UINT colors,
+                                   UINT pitch,
+                                   UINT normalize,
+                                   UINT step);
+struct gen_job *generate_job_double(int imageFuncNum,
+                                    UCHAR *buf_graf,
+                                    UINT xcenter,
+                                    UINT ycenter,
+                                    UINT width,
+                                    UINT height,
+                                    UINT colors,
+                                    UINT pitch,
+                                    UINT normalize,
+                                    UINT step);
+struct gen_job *generate_job_float32(int imageFuncNum,
+                                     UCHAR *buf_graf,
+                                     UINT xcenter,
+                                     UINT ycenter,
+                                     UINT width,
+                                     UINT height,
+                                     UINT colors,
+                                     UINT pitch,
+                                     UINT normalize,
+                                     UINT step);
+struct gen_job *generate_job_int(int imageFuncNum,
+                                 UCHAR *buf_graf,
+                                 UINT xcenter,
+                                 UINT ycenter,
+                                 UINT width,
+                                 UINT height,
+                                 UINT colors,
+                                 UINT pitch,
+                                 UINT normalize,
+                                 UINT step);
+/* Draws the image on the calling thread, continuing where the last call
+ * stopped, until about ms milliseconds have passed. The tables the image
+ * needs, such as the polar field, are built the same way. Steps are about
+ * a row of the image or of a table, and at least one is taken. Returns 1
+ * once the image is done, could not be drawn, or drawing was aborted.
+ */
+int generate_job_run(struct gen_job *job, double ms);
+/* Frees a job. An image which is not done stays partly drawn. */
+void generate_job_free(struct gen_job *job);
 
 void fatalSDLError(const char *msg);
 void quit(int retcode);
@@ -51,10 +226,45 @@ void makeShuffledList(int *list, int listSize);
 #define DRAW_LOGO 1
 #define DRAW_FLOAT 2
 #define DRAW_SCALED 4
+#define DRAW_INT 8
+/* Live warp: the image keeps moving, see live.h */
+#define DRAW_LIVE 16
 
 void draw_init(int flags);
 void draw_same(void);
 void draw_next(void);
+/* Shows a progressively drawn image once it is complete. With time slices,
+ * also draws the next slice of the image being drawn.
+ */
+void draw_poll(void);
+/* Returns 0 while draw_next() would have to wait for time slices of the
+ * next image, which draw_poll() draws meanwhile
+ */
+int draw_ready(void);
+/* Live warp: shows the frame drawn since the last call, and starts the next */
+void draw_live(void);
+/* Live warp: the image shown begins to fade out. Slow next images are
+ * started right away.
+ */
+void draw_prepare(void);
+/* Quality governor: images predicted to take longer than ms are drawn
+ * smaller, and at full size again once there is room. 0 turns it off.
+ */
+void draw_set_budget(double ms);
+/* Makes draw_poll() draw images on the calling thread, about ms milliseconds
+ * at a time, instead of drawing them on another thread. Must be called
+ * before draw_init(). 0 turns it off.
+ */
+void draw_set_slice(double ms);
+/* Explorer: the image shown stays, with its parameters frozen, and can be
+ * panned and zoomed. Leaving shows its normal view again.
+ */
+void draw_explore(int on);
+/* Explorer: pans the image shown by dx, dy pixels and zooms it by zoom
+ * around the point x, y pixels from the image centre. Returns 0 if not
+ * exploring.
+ */
+int draw_view_move(double dx, double dy, double zoom, double x, double y);
 void draw_abort(void);
 
 extern int abort_draw;
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include "handy.h"
 #include "bit_map.h"
+#include "rng.h"
 
 /* Bit Map is 2 Bits per pixel, with 4 pixels per byte. The 4 pixels are
  * in a horizontal row. I.e. 1234 NOT 1 NOR 4
@@ -503,7 +504,7 @@ static void bit_map_uncompress (UCHAR *buf_graf,
         case 0 :
           for (int dy = 0; dy < logo_zoom; dy++) {
             for (int dx = 0; dx < logo_zoom; dx++) {
-              *(buf_graf + xsize * (y+dy) + (x+dx)) = (UCHAR)RANDOM(logo_zoom) + 192 + 0;
+              *(buf_graf + xsize * (y+dy) + (x+dx)) = (UCHAR)rng_below(&rng_draw, logo_zoom) + 192 + 0;
             }
           }
           break;
@@ -511,7 +512,7 @@ static void bit_map_uncompress (UCHAR *buf_graf,
         case 1 :
           for (int dy = 0; dy < logo_zoom; dy++) {
             for (int dx = 0; dx < logo_zoom; dx++) {
-              *(buf_graf + xsize * (y+dy) + (x+dx)) = (UCHAR)RANDOM(logo_zoom) + 192 + 9;
+              *(buf_graf + xsize * (y+dy) + (x+dx)) = (UCHAR)rng_below(&rng_draw, logo_zoom) + 192 + 9;
             }
           }
           break;
@@ -519,7 +520,7 @@ static void bit_map_uncompress (UCHAR *buf_graf,
         case 2 :
           for (int dy = 0; dy < logo_zoom; dy++) {
             for (int dx = 0; dx < logo_zoom; dx++) {
-              *(buf_graf + xsize * (y+dy) + (x+dx)) = (UCHAR)RANDOM(logo_zoom) + 192 + 17;
+              *(buf_graf + xsize * (y+dy) + (x+dx)) = (UCHAR)rng_below(&rng_draw, logo_zoom) + 192 + 17;
             }
           }
           break;
@@ -527,7 +528,7 @@ static void bit_map_uncompress (UCHAR *buf_graf,
         case 3 :
           for (int dy = 0; dy < logo_zoom; dy++) {
             for (int dx = 0; dx < logo_zoom; dx++) {
-              *(buf_graf + xsize * (y+dy) + (x+dx)) = (UCHAR)RANDOM(logo_zoom) + 192 + 25;
+              *(buf_graf + xsize * (y+dy) + (x+dx)) = (UCHAR)rng_below(&rng_draw, logo_zoom) + 192 + 25;
             }
           }
           break;
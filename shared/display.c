@@ -5,6 +5,7 @@
  * Ported to Android, iOS / iPadOS, macOS, Linux, Windows by Matthew Zavislak
  */
 
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -42,19 +43,21 @@ static inline void SDL_ShowCursor_compat(int toggle) {
 static SDL_Window *window = NULL;
 
 SDL_GLContext context;
-GLuint indtex, paltex, glprogram;
+GLuint indtex, paltex, fractex, glprogram;
 
 const GLchar vertex[] =
     "#version 100\n"
     "precision mediump float;\n"
     "attribute vec4 Position;\n"
     "attribute vec2 TexPos;\n"
+    // Part of the texture the image drawn fills
+    "uniform vec2 TexScale;\n"
     "varying vec2 TexCoord0;\n"
 
     "void main()\n"
     "{\n"
         "gl_Position = Position;\n"
-        "TexCoord0 = TexPos;\n"
+        "TexCoord0 = TexPos * TexScale;\n"
     "}\0";
 
 const GLchar fragment[] =
@@ -72,15 +75,43 @@ const GLchar fragment[] =
       // Read RGBA value for that pixel from palette texture
       "gl_FragColor = texture2D(Palette, vec2(myindex.r, 0.0));\n"
     "}\0";
+
+/* Used instead of fragment with disp_setSmooth() */
+const GLchar fragment_smooth[] =
+    "#version 100\n"
+    "precision mediump float;\n"
+    "uniform sampler2D Palette;\n"
+    "uniform sampler2D IndexTexture;\n"
+    "uniform sampler2D FractionTexture;\n"
+    "varying vec2 TexCoord0;\n"
+
+    "void main()\n"
+    "{\n"
+      // Palette index, and the entry after it in palette rotation
+      "float index = floor(texture2D(IndexTexture, TexCoord0).r * 255.0 + 0.5);\n"
+      "float next = index >= 255.0 ? 1.0 : index + 1.0;\n"
+      // How far the colour is towards the next entry, stored in 1/256
+      "float fraction = texture2D(FractionTexture, TexCoord0).r * (255.0 / 256.0);\n"
+      "gl_FragColor = mix(texture2D(Palette, vec2((index + 0.5) / 256.0, 0.0)),\n"
+      "                   texture2D(Palette, vec2((next + 0.5) / 256.0, 0.0)),\n"
+      "                   fraction);\n"
+    "}\0";
 static UCHAR *draw_buf = NULL;
+static UCHAR *frac_buf = NULL; /* with smooth, fractions of draw_buf indices */
+static int smooth = 0;
 static int fullscreen = 0;
-static int width, height;
+static int width, height; /* window size, for mouse coordinates */
+static int pixel_width, pixel_height; /* window size in pixels */
+static int buf_width, buf_height; /* size of generated images */
+static unsigned int image_width, image_height; /* size of the image drawn */
+static float render_scale = 1.0f;
 
 /* Single click debouncing - delay processing until double-click window expires */
 static Uint64 pending_click_time = 0;
 static int pending_click_x = 0;
 static int pending_click_y = 0;
 static const Uint64 DOUBLE_CLICK_DELAY_MS = 300; /* Wait 300ms to see if double-click occurs */
+static const double EXPLORE_WHEEL_ZOOM = 1.25; /* explorer zoom per wheel step */
 
 static int getInternalFormat(void) {
 #ifdef __APPLE__
@@ -114,7 +145,7 @@ void disp_setPalette(unsigned char *palette)
 {
   GLint viewport[4];
   glGetIntegerv(GL_VIEWPORT, viewport);
-  glViewport(0, 0, width, height);
+  glViewport(0, 0, pixel_width, pixel_height);
   glGetIntegerv(GL_VIEWPORT, viewport);
 
   static GLubyte glcolors[256 * 4];
@@ -136,10 +167,10 @@ void disp_setPalette(unsigned char *palette)
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
   /* Render remote overlay on top if visible */
-  remote_overlay_render_if_visible(width, height);
+  remote_overlay_render_if_visible(pixel_width, pixel_height);
   
   /* Render dim feedback if active */
-  remote_overlay_render_dim(width, height);
+  remote_overlay_render_dim(pixel_width, pixel_height);
 
   SDL_GL_SwapWindow(window);
 }
@@ -148,9 +179,20 @@ void disp_beginUpdate(UCHAR **p, unsigned int *pitch,
                       unsigned int *w, unsigned int *h)
 {
   *p = draw_buf;
-  *pitch = width;
-  *w = width;
-  *h = height;
+  *pitch = buf_width;
+  *w = buf_width;
+  *h = buf_height;
+}
+
+UCHAR *disp_fractionBuffer(void)
+{
+  return frac_buf;
+}
+
+void disp_setImageSize(unsigned int w, unsigned int h)
+{
+  image_width = MIN(MAX(w, 1), (unsigned int)buf_width);
+  image_height = MIN(MAX(h, 1), (unsigned int)buf_height);
 }
 
 void disp_finishUpdate(void)
@@ -161,8 +203,16 @@ void disp_swapBuffers(void)
 {
   glActiveTexture(GL_TEXTURE1);
   glBindTexture(GL_TEXTURE_2D, indtex);
-  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, getFormat(),
-                  GL_UNSIGNED_BYTE, draw_buf);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image_width, image_height,
+                  getFormat(), GL_UNSIGNED_BYTE, draw_buf);
+  if (smooth) {
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, fractex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image_width, image_height,
+                    getFormat(), GL_UNSIGNED_BYTE, frac_buf);
+  }
+  glUniform2f(glGetUniformLocation(glprogram, "TexScale"),
+              (float)image_width / buf_width, (float)image_height / buf_height);
 }
 
 static void disp_toggleFullscreen(void)
@@ -200,6 +250,8 @@ static void disp_processKey(
     case SDLK_LEFT:
     case SDLK_L:
       handleinput(CMD_LOCK); break;
+    case SDLK_E:
+      handleinput(CMD_EXPLORE); break;
     case SDLK_ESCAPE:
       if (fullscreen) {
         disp_toggleFullscreen();
@@ -223,14 +275,18 @@ static void display_redraw(void)
 {
   glClear(GL_COLOR_BUFFER_BIT);
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  remote_overlay_render_if_visible(width, height);
-  remote_overlay_render_dim(width, height);
+  remote_overlay_render_if_visible(pixel_width, pixel_height);
+  remote_overlay_render_dim(pixel_width, pixel_height);
   SDL_GL_SwapWindow(window);
 }
 
 
 void disp_processInput(void) {
   SDL_Event event;
+  /* Explorer movement, in window coordinates, is applied once for all
+   * events, so the image is only drawn again once.
+   */
+  float drag_x = 0.0f, drag_y = 0.0f, wheel = 0.0f, zoom_x = 0.0f, zoom_y = 0.0f;
 
   /* Check if pending single click should be processed */
   if (pending_click_time != 0) {
@@ -273,11 +329,25 @@ void disp_processInput(void) {
           }
         }
         break;
+      case SDL_EVENT_MOUSE_MOTION:
+        if (event.motion.state & SDL_BUTTON_LMASK) {
+          drag_x += event.motion.xrel;
+          drag_y += event.motion.yrel;
+        }
+        break;
+      case SDL_EVENT_MOUSE_WHEEL:
+        wheel += event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED ?
+                 -event.wheel.y : event.wheel.y;
+        zoom_x = event.wheel.mouse_x;
+        zoom_y = event.wheel.mouse_y;
+        break;
       case SDL_EVENT_KEY_DOWN:
         disp_processKey(event.key.key);
         break;
       case SDL_EVENT_DISPLAY_ORIENTATION:
       case SDL_EVENT_WINDOW_RESIZED:
+      /* Moving to a display with a different pixel density */
+      case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
         disp_init(event.window.data1,event.window.data2,fullscreen);
         handleinput(CMD_RESIZE);
         break;
@@ -295,6 +365,18 @@ void disp_processInput(void) {
         break;
     }
   }
+
+  if (drag_x != 0.0f || drag_y != 0.0f || wheel != 0.0f) {
+    double scale = (double)buf_width / width;
+    if (draw_view_move(drag_x * scale, drag_y * scale,
+                       pow(EXPLORE_WHEEL_ZOOM, wheel),
+                       (zoom_x - width / 2.0) * scale,
+                       (zoom_y - height / 2.0) * scale) &&
+        (drag_x != 0.0f || drag_y != 0.0f)) {
+      /* Dragging the image is not a click */
+      pending_click_time = 0;
+    }
+  }
 }
 
 
@@ -309,7 +391,7 @@ static void disp_freeBuffer(UCHAR **buf)
 static void disp_reallocBuffer(UCHAR **buf)
 {
   disp_freeBuffer(buf);
-  *buf = calloc(width * height, 1);
+  *buf = calloc((size_t)buf_width * buf_height, 1);
   if (*buf == NULL) {
       printf("Couldn't allocate graphics buffer.\n");
       quit(-1);
@@ -323,6 +405,9 @@ static void disp_allocateOffscreen(void)
    */
   draw_abort();
   disp_reallocBuffer(&draw_buf);
+  if (smooth) disp_reallocBuffer(&frac_buf);
+  image_width = buf_width;
+  image_height = buf_height;
 }
 
 static void disp_glerror(char *s)
@@ -484,7 +569,7 @@ static void disp_glinit(int width, int height, Uint32 videoflags)
 
   printf("[DISP] Compiling fragment shader...\n");
   fflush(stdout);
-  loadShader(glprogram, GL_FRAGMENT_SHADER, fragment);
+  loadShader(glprogram, GL_FRAGMENT_SHADER, smooth ? fragment_smooth : fragment);
   printf("[DISP] Fragment shader compiled successfully\n");
   fflush(stdout);
 
@@ -538,6 +623,14 @@ static void disp_glinit(int width, int height, Uint32 videoflags)
   glUniform1i(glGetUniformLocation(glprogram, "IndexTexture"), 1);
   glActiveTexture(GL_TEXTURE1);
   indtex = disp_newtex();
+  glUniform2f(glGetUniformLocation(glprogram, "TexScale"), 1.0f, 1.0f);
+
+  /* 8 bpp fractions of the indices, for smooth shading */
+  if (smooth) {
+    glUniform1i(glGetUniformLocation(glprogram, "FractionTexture"), 2);
+    glActiveTexture(GL_TEXTURE2);
+    fractex = disp_newtex();
+  }
 
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
@@ -547,6 +640,38 @@ static void disp_glinit(int width, int height, Uint32 videoflags)
   fflush(stdout);
 }
 
+void disp_setRenderScale(float scale)
+{
+  if (scale == DISP_SCALE_PIXELS) {
+    render_scale = DISP_SCALE_PIXELS;
+  } else {
+    render_scale = MIN(MAX(scale, DISP_SCALE_MIN), DISP_SCALE_MAX);
+  }
+}
+
+void disp_setSmooth(int on)
+{
+  smooth = on;
+}
+
+/* Chooses the size of generated images for the current window size */
+static void disp_setBufferSize(void)
+{
+  GLint max_size;
+
+  if (render_scale == DISP_SCALE_PIXELS) {
+    buf_width = pixel_width;
+    buf_height = pixel_height;
+  } else {
+    buf_width = (int)(width * render_scale + 0.5f);
+    buf_height = (int)(height * render_scale + 0.5f);
+  }
+
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  buf_width = MIN(MAX(buf_width, 1), max_size);
+  buf_height = MIN(MAX(buf_height, 1), max_size);
+}
+
 void disp_init(int newwidth, int newheight, int flags)
 {
   Uint32 videoflags;
@@ -557,7 +682,8 @@ void disp_init(int newwidth, int newheight, int flags)
   fullscreen = (flags & DISP_FULLSCREEN) ? 1 : 0;
 
   if (!inited) {
-    videoflags = (fullscreen ? SDL_WINDOW_FULLSCREEN : SDL_WINDOW_RESIZABLE);
+    videoflags = (fullscreen ? SDL_WINDOW_FULLSCREEN : SDL_WINDOW_RESIZABLE) |
+                 SDL_WINDOW_HIGH_PIXEL_DENSITY;
     SDL_ShowCursor(!fullscreen);
     disp_glinit(width, height, videoflags);
     remote_overlay_init();
@@ -567,13 +693,25 @@ void disp_init(int newwidth, int newheight, int flags)
   /* Raspberry Pi console will set window to size of full screen,
    * and not give a resize event. */
   SDL_GetWindowSize(window, &width, &height);
+  SDL_GetWindowSizeInPixels(window, &pixel_width, &pixel_height);
+  disp_setBufferSize();
+  printf("[DISP] Drawing %dx%d images for a %dx%d pixel window\n",
+         buf_width, buf_height, pixel_width, pixel_height);
 
-  /* Create or recreate texture and set viewport, eg. when resizing */
+  /* Create or recreate texture and set viewport, eg. when resizing.
+   * The textured quad scales the image to the window.
+   */
   glActiveTexture(GL_TEXTURE1);
   glBindTexture(GL_TEXTURE_2D, indtex);
-  glTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(), width, height, 0,
+  glTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(), buf_width, buf_height, 0,
                getFormat(), GL_UNSIGNED_BYTE, NULL);
-  glViewport(0, 0, width, height);
+  if (smooth) {
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, fractex);
+    glTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(), buf_width, buf_height, 0,
+                 getFormat(), GL_UNSIGNED_BYTE, NULL);
+  }
+  glViewport(0, 0, pixel_width, pixel_height);
 
   disp_allocateOffscreen();
 }
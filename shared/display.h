@@ -5,6 +5,19 @@ void disp_setPalette(unsigned char *palette);
 void disp_beginUpdate(UCHAR **p, unsigned int *pitch,
                       unsigned int *w, unsigned int *h);
 
+/* Sets the size of the image being drawn, which may be smaller than the
+ * buffer from disp_beginUpdate(). It is drawn with its width as pitch, and
+ * still fills the window when shown. Resets to the buffer size whenever the
+ * buffer changes.
+ */
+void disp_setImageSize(unsigned int w, unsigned int h);
+
+/* With disp_setSmooth(), returns the buffer for the fractions of the
+ * palette indices, with the same size and pitch as the image. Otherwise,
+ * returns NULL.
+ */
+UCHAR *disp_fractionBuffer(void);
+
 void disp_finishUpdate(void);
 
 void disp_swapBuffers(void);
@@ -13,4 +26,23 @@ void disp_processInput(void);
 
 #define DISP_FULLSCREEN 1
 
+/* Sets the size of generated images relative to the window size, from
+ * DISP_SCALE_MIN to DISP_SCALE_MAX. DISP_SCALE_PIXELS instead matches the
+ * pixel density of the display. Images are scaled to the window when shown,
+ * so lower scales trade sharpness for faster drawing. Takes effect at the
+ * next disp_init().
+ */
+#define DISP_SCALE_PIXELS 0.0f
+#define DISP_SCALE_MIN 0.25f
+#define DISP_SCALE_MAX 2.0f
+
+void disp_setRenderScale(float scale);
+
+/* Shades smoothly between adjacent palette entries, using the fractions
+ * from disp_fractionBuffer(). This removes banding where colours change
+ * slowly, for one more byte per pixel to draw and upload. Takes effect at
+ * the first disp_init().
+ */
+void disp_setSmooth(int on);
+
 void disp_init(int width, int height, int flags);
@@ -5,6 +5,10 @@
  * Ported to Android, iOS / iPadOS, macOS, Linux, Windows by Matthew Zavislak
  */
 
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
 #include <SDL3/SDL.h>
 
 /* SDL 3 compatibility fixes */
@@ -26,43 +30,423 @@ static inline int SDL_UnlockMutex_compat(SDL_Mutex *mutex) {
 #include "acidwarp.h"
 #include "bit_map.h"
 #include "display.h"
+#include "expr.h"
+#include "live.h"
+
+/* Pixels per sample in both directions of the coarse preview */
+#define PREVIEW_STEP 8
+
+/* Images which are waited for are shown as a coarse preview first if they
+ * are predicted to take longer than this. Quicker ones are drawn directly,
+ * because their preview would hardly show any sooner.
+ */
+#define PREVIEW_MIN_MS 50
+
+/* In live warp mode, the next image is started as soon as the image shown
+ * begins to fade out if it is predicted to take longer than this, so it is
+ * ready when the fade ends. Quicker ones keep the image shown moving until
+ * then.
+ */
+#define LIVE_EARLY_MS 20
+
+/* Quality governor: images predicted to take longer than the budget set by
+ * draw_set_budget() are drawn smaller, at a scale which is a multiple of
+ * 1 / GOVERNOR_STEPS, and at least GOVERNOR_MIN_SCALE. A function only goes
+ * back to a larger scale once that would take under GOVERNOR_UP of the
+ * budget, so it does not flip between two sizes.
+ */
+#define GOVERNOR_STEPS 8
+#define GOVERNOR_MIN_SCALE 0.25
+#define GOVERNOR_UP 0.8
+
+/* Live warp moves by at most this much per frame, so pauses and slow
+ * frames don't make the image jump.
+ */
+#define LIVE_MAX_STEP_MS 250
+
+/* Explorer redraws are shown as a coarse preview first if they are
+ * predicted to take longer than about one frame.
+ */
+#define EXPLORE_PREVIEW_MIN_MS 16
+#define EXPLORE_MIN_ZOOM 0.125
+#define EXPLORE_MAX_ZOOM 1e9
 
-static int imageFuncList[NUM_IMAGE_FUNCTIONS];
+static int *imageFuncList = NULL;
+static int numImageFuncs = 0;
 static int imageFuncListIndex=0;
 static int flags = 0;
 static bool drawnext = false;
 static SDL_Condition *drawnext_cond = NULL;
 static bool drawdone = false;
 static SDL_Condition *drawdone_cond = NULL;
+static bool previewdone = false; /* coarse preview waiting to be shown */
+static bool refining = false; /* preview shown, full image still drawing */
 static SDL_Mutex *draw_mtx = NULL;
 static int drawing_main(void *param);
 static SDL_Thread *drawing_thread = NULL;
 int abort_draw = 0;
 int quit_draw = 0;
 static int redraw_same = 0;
+static bool live_advance = false; /* live warp: next image, not a new frame */
+static bool live_drawing = false; /* live warp: drawing a frame of the image shown */
+static struct live_warp live;
+static Uint64 live_ticks;
+/* Measured nanoseconds per pixel and unit of generate_image_info() cost.
+ * Only the drawing thread changes it, with draw_mtx locked.
+ */
+static double ns_per_cost = 1.0;
+/* Per image function, indexed by func_slot(). Also only changed by the
+ * drawing thread with draw_mtx locked.
+ */
+static struct func_stats {
+  double ns_per_pixel;          /* measured, 0 until the function is drawn */
+  double scale;                 /* chosen by the governor last time */
+} *func_stats = NULL;
+static double budget_ms = 0.0;  /* 0 turns the governor off */
+/* Explorer state, changed by the main thread with draw_mtx locked */
+static bool exploring = false;
+static struct gen_view view = { 1.0, 0.0, 0.0 };
+/* View of the image being drawn, only used by the drawing thread */
+static const struct gen_view *drawing_view = NULL;
+/* Time slices: images are drawn on the main thread by draw_poll(), in
+ * slices of this many milliseconds, instead of on the drawing thread. The
+ * drawing thread still decides what to draw, but sleeps while the main
+ * thread draws it. 0 turns it off.
+ */
+static double slice_ms = 0.0;
+/* The drawing thread waits for the main thread to draw slice_image.
+ * Both are changed with draw_mtx locked.
+ */
+static bool slice_wanted = false;
+static struct {
+  int which;
+  UCHAR *buf_graf;
+  unsigned int buf_graf_stride, width, height;
+  UINT xcenter, ycenter, step;
+} slice_image;
+/* Only used by the main thread, with draw_mtx locked */
+static struct gen_job *slice_job = NULL;
+static Uint64 slice_ns;         /* spent drawing slice_image so far */
+
+/* Image generators images are drawn with */
+enum draw_engine { ENGINE_NONE, ENGINE_DOUBLE, ENGINE_FLOAT, ENGINE_INT };
+
+/* Chooses the generator of image which, and prepares the fraction buffer
+ * for it.
+ */
+static enum draw_engine choose_engine(int which, unsigned int buf_graf_stride,
+                                      unsigned int height) {
+  /* Zoomed in coordinates need double precision */
+  if (drawing_view != NULL) return ENGINE_DOUBLE;
+  /* Formulas are only compiled for floating point */
+  if ((flags & DRAW_FLOAT) || which >= FIRST_FORMULA_FUNCTION) {
+    return ENGINE_FLOAT;
+  }
+  if (flags & DRAW_INT) {
+    UCHAR *frac = disp_fractionBuffer();
+    /* Fixed point colours are whole palette indices */
+    if (frac != NULL) memset(frac, 0, (size_t)buf_graf_stride * height);
+    return ENGINE_INT;
+  }
+  return ENGINE_NONE;
+}
+
+/* Starts drawing image which like generate(), see generate_job_float() */
+static struct gen_job *generate_job(int which, UCHAR *buf_graf,
+                                    unsigned int buf_graf_stride,
+                                    unsigned int width, unsigned int height,
+                                    UINT xcenter, UINT ycenter, UINT step) {
+  switch (choose_engine(which, buf_graf_stride, height)) {
+  case ENGINE_DOUBLE:
+    return generate_job_double(which,
+                               buf_graf, xcenter, ycenter, width, height,
+                               256, buf_graf_stride, flags & DRAW_SCALED, step);
+  case ENGINE_FLOAT:
+    return generate_job_float(which,
+                              buf_graf, xcenter, ycenter, width, height,
+                              256, buf_graf_stride, flags & DRAW_SCALED, step);
+  case ENGINE_INT:
+    return generate_job_int(which,
+                            buf_graf, xcenter, ycenter, width, height,
+                            256, buf_graf_stride, flags & DRAW_SCALED, step);
+  default:
+    return NULL;
+  }
+}
+
+/* Draws image which, and returns the nanoseconds spent drawing it */
+static Uint64 generate(int which, UCHAR *buf_graf,
+                       unsigned int buf_graf_stride,
+                       unsigned int width, unsigned int height,
+                       UINT xcenter, UINT ycenter, UINT step) {
+  Uint64 start = SDL_GetTicksNS();
+
+  if (slice_ms > 0.0) {
+    /* Waits while the main thread draws it */
+    SDL_LockMutex(draw_mtx);
+    slice_image.which = which;
+    slice_image.buf_graf = buf_graf;
+    slice_image.buf_graf_stride = buf_graf_stride;
+    slice_image.width = width;
+    slice_image.height = height;
+    slice_image.xcenter = xcenter;
+    slice_image.ycenter = ycenter;
+    slice_image.step = step;
+    slice_wanted = true;
+    SDL_SignalCondition(drawdone_cond);
+    while (slice_wanted) {
+      SDL_WaitCondition(drawnext_cond, draw_mtx);
+    }
+    SDL_UnlockMutex(draw_mtx);
+    return slice_ns;
+  }
+
+  switch (choose_engine(which, buf_graf_stride, height)) {
+  case ENGINE_DOUBLE:
+    generate_image_double(which,
+                          buf_graf, xcenter, ycenter, width, height,
+                          256, buf_graf_stride, flags & DRAW_SCALED, step);
+    break;
+  case ENGINE_FLOAT:
+    generate_image_float(which,
+                         buf_graf, xcenter, ycenter, width, height,
+                         256, buf_graf_stride, flags & DRAW_SCALED, step);
+    break;
+  case ENGINE_INT:
+    generate_image_int(which,
+                       buf_graf, xcenter, ycenter, width, height,
+                       256, buf_graf_stride, flags & DRAW_SCALED, step);
+    break;
+  default:
+    break;
+  }
+  return SDL_GetTicksNS() - start;
+}
+
+/* Time slices: draws the next slice of the image the drawing thread waits
+ * for. Called by the main thread with draw_mtx locked. The drawing thread
+ * is waiting meanwhile, so nothing else needs the lock.
+ */
+static void draw_slice(void) {
+  Uint64 start = SDL_GetTicksNS();
+  bool done = true;
+
+  if (slice_job == NULL) {
+    slice_ns = 0;
+    slice_job = generate_job(slice_image.which, slice_image.buf_graf,
+                             slice_image.buf_graf_stride,
+                             slice_image.width, slice_image.height,
+                             slice_image.xcenter, slice_image.ycenter,
+                             slice_image.step);
+  }
+  if (slice_job != NULL) {
+    done = generate_job_run(slice_job, slice_ms);
+  }
+  slice_ns += SDL_GetTicksNS() - start;
+
+  if (done) {
+    if (slice_job != NULL) generate_job_free(slice_job);
+    slice_job = NULL;
+    slice_wanted = false;
+    SDL_SignalCondition(drawnext_cond);
+  }
+}
+
+/* Waits with draw_mtx locked until the drawing thread signals drawdone_cond.
+ * With time slices, it may be waiting for an image to be drawn instead, of
+ * which the next slice is drawn. Callers check what they wait for again
+ * after each call, see draw_ready().
+ */
+static void wait_drawing(void) {
+  if (slice_wanted) {
+    draw_slice();
+  } else {
+    SDL_WaitCondition(drawdone_cond, draw_mtx);
+  }
+}
+
+/* Live warp: sets the parameters of the next frame. Unless frame is set,
+ * this is the first frame of a new image. Explored images don't move.
+ */
+static void live_next(int frame, unsigned int width, unsigned int height,
+                      struct gen_warp *warp, UINT *xcenter, UINT *ycenter) {
+  Uint64 now = SDL_GetTicks();
+  double seconds = 0.0;
 
-static void draw(int which) {
+  if (frame) {
+    if (drawing_view == NULL) {
+      seconds = MIN(now - live_ticks, LIVE_MAX_STEP_MS) / 1000.0;
+    }
+  } else {
+    live_begin(&live);
+  }
+  live_ticks = now;
+  live_frame(&live, seconds, width, height, warp, xcenter, ycenter);
+  generate_set_warp(warp);
+}
+
+/* Index of image function which in func_stats */
+static int func_slot(int which) {
+  return which >= FIRST_FORMULA_FUNCTION ?
+         which - FIRST_FORMULA_FUNCTION + NUM_IMAGE_FUNCTIONS : which;
+}
+
+/* Milliseconds image which is predicted to take at this size. Functions
+ * which were not drawn yet are predicted from their cost.
+ */
+static double predicted_ms(int which, unsigned int pixels) {
+  struct gen_info info;
+  double ns;
+
+  if (which < 0) return 0.0;
+  ns = func_stats[func_slot(which)].ns_per_pixel;
+  if (ns == 0.0) {
+    generate_image_info(which, &info);
+    ns = info.cost * ns_per_cost;
+  }
+  return ns * pixels / 1000000.0;
+}
+
+/* Largest governor scale at which image which takes at most ms */
+static double scale_within(int which, unsigned int pixels, double ms) {
+  double predicted = predicted_ms(which, pixels), scale;
+
+  if (predicted <= ms) return 1.0;
+  scale = floor(sqrt(ms / predicted) * GOVERNOR_STEPS) / GOVERNOR_STEPS;
+  return MAX(scale, GOVERNOR_MIN_SCALE);
+}
+
+/* Scale the governor picks for image which, drawn at width x height at
+ * full scale. Called with draw_mtx locked.
+ */
+static double governed_scale(int which, unsigned int width,
+                             unsigned int height) {
+  double last, scale;
+
+  if (which < 0 || budget_ms <= 0.0) return 1.0;
+  last = func_stats[func_slot(which)].scale;
+  scale = scale_within(which, width * height, budget_ms);
+  if (scale > last) {
+    scale = MAX(last, scale_within(which, width * height,
+                                   GOVERNOR_UP * budget_ms));
+  }
+  return scale;
+}
+
+/* Updates the measured speed from image which, drawn at this scale with
+ * this many pixels in ns
+ */
+static void learn_cost(int which, double scale, unsigned int pixels,
+                       Uint64 ns) {
+  struct func_stats *stats = &func_stats[func_slot(which)];
+  struct gen_info info;
+
+  generate_image_info(which, &info);
+  SDL_LockMutex(draw_mtx);
+  ns_per_cost = 0.75 * ns_per_cost + 0.25 * ns / ((double)info.cost * pixels);
+  stats->ns_per_pixel = stats->ns_per_pixel == 0.0 ? (double)ns / pixels :
+                        0.5 * stats->ns_per_pixel + 0.5 * ns / pixels;
+  if (scale != stats->scale) {
+    printf("[DRAW] Drawing image function %d at %d%% size\n",
+           which, (int)(scale * 100 + 0.5));
+    stats->scale = scale;
+  }
+  SDL_UnlockMutex(draw_mtx);
+}
+
+/* Hands the coarse preview to the main thread, and waits until it has been
+ * uploaded, because refining overwrites the same buffer.
+ */
+static void draw_preview(void) {
+  SDL_LockMutex(draw_mtx);
+  previewdone = true;
+  SDL_SignalCondition(drawdone_cond);
+  while (previewdone && !abort_draw) {
+    SDL_WaitCondition(drawnext_cond, draw_mtx);
+  }
+  previewdone = false;
+  SDL_UnlockMutex(draw_mtx);
+}
+
+/* Draws image which. In live warp mode, frame is set for further frames
+ * of the image already shown. Otherwise, the image uses params, which are
+ * chosen now if fresh is set. view is the explorer view, or NULL.
+ */
+static void draw(int which, int progressive, int frame,
+                 struct gen_warp *params, int fresh,
+                 const struct gen_view *view) {
   UCHAR *buf_graf;
   unsigned int buf_graf_stride, width, height;
   disp_beginUpdate(&buf_graf, &buf_graf_stride, &width, &height);
   if (which < 0) {
+    UCHAR *frac = disp_fractionBuffer();
+    disp_setImageSize(width, height);
     writeBitmapImageToArray(buf_graf, width, height,buf_graf_stride);
+    if (frac != NULL) memset(frac, 0, (size_t)buf_graf_stride * height);
   } else {
-    if (flags & DRAW_FLOAT) {
-      generate_image_float(which,
-                           buf_graf, width/2, height/2, width, height,
-                           256, buf_graf_stride, flags & DRAW_SCALED);
+    struct gen_warp warp;
+    UINT xcenter, ycenter;
+    Uint64 ns;
+    double scale;
+
+    /* A smaller image is drawn compactly into the same buffer */
+    SDL_LockMutex(draw_mtx);
+    scale = governed_scale(which, width, height);
+    SDL_UnlockMutex(draw_mtx);
+    width = MAX((unsigned int)(width * scale + 0.5), 1);
+    height = MAX((unsigned int)(height * scale + 0.5), 1);
+    buf_graf_stride = width;
+    disp_setImageSize(width, height);
+    xcenter = width/2;
+    ycenter = height/2;
+    drawing_view = view;
+    generate_set_view(view);
+    generate_set_fraction(disp_fractionBuffer());
+    if (flags & DRAW_LIVE) {
+      live_next(frame, width, height, &warp, &xcenter, &ycenter);
+    } else {
+      /* The preview and any redraws use the same random offsets */
+      if (fresh) generate_params(params);
+      generate_set_warp(params);
+    }
+    if (progressive && predicted_ms(which, width * height) >=
+                       (view != NULL ? EXPLORE_PREVIEW_MIN_MS : PREVIEW_MIN_MS)) {
+      generate(which, buf_graf, buf_graf_stride, width, height,
+               xcenter, ycenter, PREVIEW_STEP);
+      draw_preview();
     }
+    ns = generate(which, buf_graf, buf_graf_stride, width, height,
+                  xcenter, ycenter, 1);
+    if (!abort_draw) {
+      learn_cost(which, scale, width * height, ns);
+    }
+    generate_set_warp(NULL);
+    generate_set_view(NULL);
+    generate_set_fraction(NULL);
+    drawing_view = NULL;
   }
   disp_finishUpdate();
 }
 
+/* Shuffles the built in functions together with the loaded formulas */
+static void shuffle_functions(void)
+{
+  int i;
+
+  makeShuffledList(imageFuncList, numImageFuncs);
+  for (i = 0; i < numImageFuncs; ++i) {
+    if (imageFuncList[i] >= NUM_IMAGE_FUNCTIONS) {
+      imageFuncList[i] += FIRST_FORMULA_FUNCTION - NUM_IMAGE_FUNCTIONS;
+    }
+  }
+}
+
 static void draw_advance(void)
 {
   flags &= ~DRAW_LOGO;
-  if (++imageFuncListIndex >= NUM_IMAGE_FUNCTIONS) {
+  if (++imageFuncListIndex >= numImageFuncs) {
     imageFuncListIndex = 0;
-    makeShuffledList(imageFuncList, NUM_IMAGE_FUNCTIONS);
+    shuffle_functions();
   }
 }
 
@@ -74,10 +458,21 @@ static void draw_advance(void)
 static int drawing_main(void *param) {
   int displayed_img;
   int draw_img = (flags & DRAW_LOGO) ? -1 : imageFuncList[imageFuncListIndex];
+  struct gen_warp displayed_params = { { 0 } }, draw_params = { { 0 } };
+  struct gen_view draw_view;
+  /* The first image and redraws are waited for, so they are drawn
+   * progressively. Other images are drawn while the previous one shows.
+   */
+  int progressive = 1, fresh = 1, viewing = 0;
+  /* draw_img is drawn ahead of being shown, and a redraw of the image
+   * shown overwrote it, so it needs to be drawn again.
+   */
+  bool ahead = false, again = false;
   displayed_img = draw_img;
   while (1) {
     /* Draw next image to back buffer */
-    draw(draw_img);
+    draw(draw_img, progressive, live_drawing, &draw_params, fresh,
+         viewing ? &draw_view : NULL);
 
     /* Tell main thread that image is drawn */
     SDL_LockMutex(draw_mtx);
@@ -89,18 +484,43 @@ static int drawing_main(void *param) {
       SDL_WaitCondition(drawnext_cond, draw_mtx);
     }
     drawnext = false;
+    /* In live warp mode, the image shown keeps moving until draw_next()
+     * asks for the next one.
+     */
+    live_drawing = (flags & DRAW_LIVE) && !live_advance;
+    live_advance = false;
+    /* Only the image shown is explored */
+    viewing = exploring && (redraw_same || live_drawing);
+    if (viewing) draw_view = view;
     SDL_UnlockMutex(draw_mtx);
 
     if (quit_draw) break;
 
+    progressive = redraw_same;
+    fresh = 0;
     if (redraw_same) {
-      draw_img = displayed_img;
+      if (ahead) {
+        again = true;
+        ahead = false;
+        draw_img = displayed_img;
+        draw_params = displayed_params;
+      }
       redraw_same = 0;
+    } else if (live_drawing) {
+      displayed_img = draw_img;
+      ahead = false;
     } else {
-      /* move to the next image */
-      draw_advance();
+      if (again) {
+        again = false;
+      } else {
+        /* move to the next image */
+        draw_advance();
+      }
       displayed_img = draw_img;
+      displayed_params = draw_params;
       draw_img = imageFuncList[imageFuncListIndex];
+      fresh = 1;
+      ahead = true;
     }
   }
   return 0;
@@ -111,27 +531,147 @@ void draw_abort(void) {
     SDL_LockMutex(draw_mtx);
     while (!drawdone) {
       abort_draw = 1;
-      SDL_WaitCondition(drawdone_cond, draw_mtx);
+      /* Also wakes the drawing thread if it waits with a preview */
+      SDL_SignalCondition(drawnext_cond);
+      wait_drawing();
       abort_draw = 0;
     }
+    /* An image being refined was abandoned */
+    refining = false;
     SDL_UnlockMutex(draw_mtx);
   }
 }
 
-void draw_next(void) {
-  /* Wait for image to finish drawing image */
-  SDL_LockMutex(draw_mtx);
-  while (!drawdone) {
-    SDL_WaitCondition(drawdone_cond, draw_mtx);
-  }
-
+/* Called with draw_mtx locked once the drawing thread is done */
+static void draw_show(void) {
   /* This should actually display what the thread drew */
   disp_swapBuffers();
+  refining = false;
 
   /* Tell drawing thread it can continue now that buffers are swapped */
   drawnext = true;
   drawdone = false;
   SDL_SignalCondition(drawnext_cond);
+}
+
+/* Shows the next image once it is drawn. With advance in live warp mode,
+ * the frame being drawn is still of the image shown, so it is dropped, and
+ * the next image is drawn instead.
+ */
+static void show_next(bool advance) {
+  SDL_LockMutex(draw_mtx);
+
+  /* Finish showing a progressively drawn image first */
+  if (refining) {
+    while (!drawdone) {
+      wait_drawing();
+    }
+    draw_show();
+  }
+
+  if (advance && live_drawing) {
+    while (!drawdone) {
+      wait_drawing();
+    }
+    live_advance = true;
+    drawnext = true;
+    drawdone = false;
+    SDL_SignalCondition(drawnext_cond);
+  }
+
+  /* Wait for image to finish drawing image, or for its preview */
+  while (!drawdone && !previewdone) {
+    wait_drawing();
+  }
+
+  if (drawdone) {
+    draw_show();
+  } else {
+    /* Show the preview, and let the thread refine it. draw_poll() shows
+     * the full image once it is done.
+     */
+    disp_swapBuffers();
+    previewdone = false;
+    refining = true;
+    SDL_SignalCondition(drawnext_cond);
+  }
+  SDL_UnlockMutex(draw_mtx);
+}
+
+void draw_next(void) {
+  show_next(true);
+}
+
+int draw_ready(void) {
+  bool ready;
+
+  if (slice_ms <= 0.0) return 1;
+  SDL_LockMutex(draw_mtx);
+  /* The frame of the image shown is dropped, like draw_next() would, so
+   * the next image is drawn by draw_poll()
+   */
+  if (live_drawing && drawdone && !refining) {
+    live_advance = true;
+    drawnext = true;
+    drawdone = false;
+    SDL_SignalCondition(drawnext_cond);
+  }
+  ready = !slice_wanted && !live_drawing;
+  SDL_UnlockMutex(draw_mtx);
+  return ready;
+}
+
+void draw_poll(void) {
+  SDL_LockMutex(draw_mtx);
+  if (slice_wanted) {
+    draw_slice();
+  }
+  if (refining && drawdone) {
+    draw_show();
+  }
+  SDL_UnlockMutex(draw_mtx);
+}
+
+void draw_live(void) {
+  if (!(flags & DRAW_LIVE)) return;
+  SDL_LockMutex(draw_mtx);
+  /* The logo does not move, and a next image drawn early by draw_prepare()
+   * waits for draw_next().
+   */
+  if (drawdone && !refining && live_drawing && !(flags & DRAW_LOGO)) {
+    draw_show();
+  }
+  SDL_UnlockMutex(draw_mtx);
+}
+
+void draw_prepare(void) {
+  UCHAR *buf_graf;
+  unsigned int buf_graf_stride, width, height;
+  int next;
+
+  if (!(flags & DRAW_LIVE)) return;
+  disp_beginUpdate(&buf_graf, &buf_graf_stride, &width, &height);
+  SDL_LockMutex(draw_mtx);
+  /* After the last image of the list, the next is not shuffled yet */
+  next = imageFuncListIndex + 1 < numImageFuncs ?
+         imageFuncList[imageFuncListIndex + 1] : -1;
+  if (next >= 0) {
+    double scale = governed_scale(next, width, height);
+    width = MAX((unsigned int)(width * scale + 0.5), 1);
+    height = MAX((unsigned int)(height * scale + 0.5), 1);
+  }
+  if (live_drawing && (next < 0 ||
+                       predicted_ms(next, width * height) >= LIVE_EARLY_MS)) {
+    live_advance = true;
+    if (drawdone) {
+      /* Drop the frame waiting to be shown. Otherwise, the thread starts
+       * the next image once draw_live() has shown the frame being drawn.
+       */
+      drawnext = true;
+      drawdone = false;
+      SDL_SignalCondition(drawnext_cond);
+    }
+  }
   SDL_UnlockMutex(draw_mtx);
 }
 
@@ -146,12 +686,75 @@ static void draw_continue(void) {
 void draw_same(void) {
   redraw_same = 1;
   draw_continue();
-  draw_next();
+  show_next(false);
+}
+
+/* Explorer: draws the image shown again in the new view. A redraw still
+ * in progress is abandoned. Live warp frames pick up the view by themselves.
+ */
+static void view_changed(void) {
+  if (flags & DRAW_LIVE) return;
+  draw_abort();
+  draw_same();
+}
+
+void draw_explore(int on) {
+  bool moved;
+
+  SDL_LockMutex(draw_mtx);
+  moved = view.zoom != 1.0 || view.x != 0.0 || view.y != 0.0;
+  exploring = on;
+  view.zoom = 1.0;
+  view.x = view.y = 0.0;
+  SDL_UnlockMutex(draw_mtx);
+  if (moved) view_changed();
+}
+
+int draw_view_move(double dx, double dy, double zoom, double x, double y) {
+  UCHAR *buf_graf;
+  unsigned int buf_graf_stride, width, height;
+  double unit, old;
+
+  if (!exploring) return 0;
+  disp_beginUpdate(&buf_graf, &buf_graf_stride, &width, &height);
+  /* Image function coordinates per pixel, the same in both directions */
+  unit = (flags & DRAW_SCALED) ? 320.0 / width : 1.0;
+  SDL_LockMutex(draw_mtx);
+  old = view.zoom;
+  view.zoom = MIN(MAX(old * zoom, EXPLORE_MIN_ZOOM), EXPLORE_MAX_ZOOM);
+  /* The point zoomed around stays where it is */
+  view.x += x * unit * (1.0 / old - 1.0 / view.zoom) - dx * unit / view.zoom;
+  view.y += y * unit * (1.0 / old - 1.0 / view.zoom) - dy * unit / view.zoom;
+  SDL_UnlockMutex(draw_mtx);
+  view_changed();
+  return 1;
+}
+
+void draw_set_slice(double ms) {
+  slice_ms = ms;
+}
+
+void draw_set_budget(double ms) {
+  SDL_LockMutex(draw_mtx);
+  budget_ms = ms;
+  SDL_UnlockMutex(draw_mtx);
 }
 
 void draw_init(int draw_flags) {
+  int i;
+
   flags = draw_flags;
-  makeShuffledList(imageFuncList, NUM_IMAGE_FUNCTIONS);
+  numImageFuncs = NUM_IMAGE_FUNCTIONS + expr_count();
+  imageFuncList = malloc(numImageFuncs * sizeof(int));
+  func_stats = malloc(numImageFuncs * sizeof(struct func_stats));
+  if (imageFuncList == NULL || func_stats == NULL) {
+    fatalSDLError("allocating the image function list");
+  }
+  for (i = 0; i < numImageFuncs; ++i) {
+    func_stats[i].ns_per_pixel = 0.0;
+    func_stats[i].scale = 1.0;
+  }
+  shuffle_functions();
   abort_draw = 0;
   quit_draw = 0;
   if (!(draw_mtx = SDL_CreateMutex()) ||
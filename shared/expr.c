@@ -0,0 +1,674 @@
+/* Formula image functions for Acid Warp */
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "handy.h"
+#include "img_float.h"
+#include "expr.h"
+
+#define EXPR_MAX_CODE 256
+#define EXPR_MAX_DEPTH 16
+#define EXPR_MAX_COLUMNS 16
+#define EXPR_MAX_LOADED 256
+
+enum expr_op {
+  OP_CONST,                     /* push value */
+  OP_VAR,                       /* push variable arg */
+  OP_COLUMN,                    /* push column term arg */
+  /* Unary operations replace the value on top of the stack */
+  OP_NEG, OP_INT, OP_ABS, OP_SIN, OP_COS,
+  /* Binary operations replace the two values on top of the stack */
+  OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_FMOD, OP_XOR, OP_MIN, OP_MAX,
+  OP_DIST, OP_ANGLE
+};
+
+/* Variables. Those before VAR_Y vary within a row. */
+enum {
+  VAR_X, VAR_DX, VAR_DIST, VAR_ANGLE,
+  VAR_Y, VAR_DY, VAR_WIDTH, VAR_HEIGHT, VAR_OFFSETS
+};
+
+static const struct {
+  const char *name;
+  int var;
+} vars[] = {
+  { "x", VAR_X }, { "dx", VAR_DX }, { "dist", VAR_DIST }, { "angle", VAR_ANGLE },
+  { "y", VAR_Y }, { "dy", VAR_DY }, { "width", VAR_WIDTH }, { "height", VAR_HEIGHT },
+  { "x1", VAR_OFFSETS },     { "x2", VAR_OFFSETS + 1 },
+  { "x3", VAR_OFFSETS + 2 }, { "x4", VAR_OFFSETS + 3 },
+  { "y1", VAR_OFFSETS + 4 }, { "y2", VAR_OFFSETS + 5 },
+  { "y3", VAR_OFFSETS + 6 }, { "y4", VAR_OFFSETS + 7 }
+};
+
+static const struct {
+  const char *name;
+  int op, args;
+} funcs[] = {
+  { "sin", OP_SIN, 1 }, { "cos", OP_COS, 1 },
+  { "dist", OP_DIST, 2 }, { "angle", OP_ANGLE, 2 },
+  { "fmod", OP_FMOD, 2 }, { "int", OP_INT, 1 }, { "xor", OP_XOR, 2 },
+  { "abs", OP_ABS, 1 }, { "min", OP_MIN, 2 }, { "max", OP_MAX, 2 }
+};
+
+/* Operands of an instruction which vary within the row. Others are the
+ * same for the whole row, and are computed only once.
+ */
+#define VARY_A 1
+#define VARY_B 2
+
+struct insn {
+  UCHAR op;
+  UCHAR vary;
+  UCHAR arg;
+  double value;
+};
+
+struct expr {
+  struct insn code[EXPR_MAX_CODE];
+  int len;
+  /* Column terms, with term i from cols[col_end[i-1]] to cols[col_end[i]] */
+  struct insn cols[EXPR_MAX_CODE];
+  int col_end[EXPR_MAX_COLUMNS];
+  int num_cols;
+  int vary;                     /* the result varies within a row */
+  int depth;
+};
+
+/* What a value depends on. Values depending on neither are the same for
+ * the whole image.
+ */
+#define DEP_ROW 1
+#define DEP_COL 2
+
+struct compiler {
+  const char *text, *p;
+  struct expr *e;
+  /* Values on the stack when the code so far runs: first instruction
+   * computing each, and what it depends on
+   */
+  struct {
+    int start, dep;
+  } stack[EXPR_MAX_DEPTH];
+  int sp;
+  char *error;
+  size_t error_size;
+  int failed;
+};
+
+static double scalar_op(int op, double a, double b)
+{
+  double r;
+
+  switch (op) {
+    case OP_NEG: return -a;
+    case OP_INT: return (int)a;
+    case OP_ABS: return fabs(a);
+    case OP_SIN: return lut_sin(a);
+    case OP_COS: return lut_cos(a);
+    case OP_ADD: return a + b;
+    case OP_SUB: return a - b;
+    case OP_MUL: return a * b;
+    case OP_DIV: return a / b;
+    case OP_FMOD: return fmod(a, b);
+    case OP_XOR: return (int)a ^ (int)b;
+    case OP_MIN: return a < b ? a : b;
+    case OP_MAX: return a > b ? a : b;
+    case OP_DIST: lut_dist_v(&a, b, &r, 1); return r;
+    default: lut_angle_v(&a, b, &r, 1); return r;
+  }
+}
+
+/* Compiler */
+
+static void fail(struct compiler *c, const char *msg)
+{
+  if (c->failed) return;
+  c->failed = 1;
+  snprintf(c->error, c->error_size, "%s at column %d",
+           msg, (int)(c->p - c->text) + 1);
+}
+
+static void emit(struct compiler *c, int op, int vary, int arg, double value)
+{
+  struct expr *e = c->e;
+
+  if (e->len >= EXPR_MAX_CODE) {
+    fail(c, "Formula too long");
+    return;
+  }
+  e->code[e->len].op = (UCHAR)op;
+  e->code[e->len].vary = (UCHAR)vary;
+  e->code[e->len].arg = (UCHAR)arg;
+  e->code[e->len].value = value;
+  ++e->len;
+}
+
+static void push(struct compiler *c, int op, int dep, int arg, double value)
+{
+  if (c->sp >= EXPR_MAX_DEPTH) {
+    fail(c, "Formula too deeply nested");
+    return;
+  }
+  c->stack[c->sp].start = c->e->len;
+  c->stack[c->sp].dep = dep;
+  ++c->sp;
+  emit(c, op, (dep & DEP_COL) ? VARY_A : 0, arg, value);
+}
+
+/* Moves the code of stack value i to a column term if it only depends
+ * on x, so it is computed once per image instead of for every row.
+ */
+static void hoist(struct compiler *c, int i)
+{
+  struct expr *e = c->e;
+  int start = c->stack[i].start;
+  int end = i + 1 < c->sp ? c->stack[i + 1].start : e->len;
+  int len = end - start, term = e->num_cols, first;
+
+  if (c->stack[i].dep != DEP_COL || len <= 1) return;
+  first = term > 0 ? e->col_end[term - 1] : 0;
+  if (term >= EXPR_MAX_COLUMNS || first + len > EXPR_MAX_CODE) return;
+
+  memcpy(e->cols + first, e->code + start, len * sizeof(struct insn));
+  e->col_end[term] = first + len;
+  e->num_cols = term + 1;
+
+  e->code[start].op = OP_COLUMN;
+  e->code[start].vary = VARY_A;
+  e->code[start].arg = (UCHAR)term;
+  memmove(e->code + start + 1, e->code + end,
+          (e->len - end) * sizeof(struct insn));
+  e->len -= len - 1;
+  if (i + 1 < c->sp) c->stack[i + 1].start = start + 1;
+}
+
+/* Replaces the top args values of the stack with op applied to them */
+static void apply(struct compiler *c, int op, int args)
+{
+  struct expr *e = c->e;
+  int a = c->sp - args, b = c->sp - 1;
+  int dep, vary = 0;
+
+  if (c->failed) return;
+  dep = c->stack[a].dep | c->stack[b].dep;
+  if (args == 2 && dep == (DEP_ROW | DEP_COL)) {
+    hoist(c, b);
+    hoist(c, a);
+  }
+
+  /* Operations on constants are done right away */
+  if (e->len - c->stack[a].start == args &&
+      e->code[c->stack[a].start].op == OP_CONST &&
+      e->code[e->len - 1].op == OP_CONST) {
+    struct insn *in = &e->code[c->stack[a].start];
+    in->value = scalar_op(op, in->value, e->code[e->len - 1].value);
+    e->len = c->stack[a].start + 1;
+    c->sp = a + 1;
+    return;
+  }
+
+  if (c->stack[a].dep & DEP_COL) vary |= VARY_A;
+  if (args == 2 && (c->stack[b].dep & DEP_COL)) vary |= VARY_B;
+  emit(c, op, vary, 0, 0.0);
+  c->stack[a].dep = dep;
+  c->sp = a + 1;
+}
+
+static void skip_space(struct compiler *c)
+{
+  while (isspace((unsigned char)*c->p)) ++c->p;
+}
+
+static int accept(struct compiler *c, char ch)
+{
+  skip_space(c);
+  if (*c->p != ch) return 0;
+  ++c->p;
+  return 1;
+}
+
+static void expect(struct compiler *c, char ch)
+{
+  char msg[32];
+
+  if (!accept(c, ch)) {
+    snprintf(msg, sizeof(msg), "Expected '%c'", ch);
+    fail(c, msg);
+  }
+}
+
+static void parse_sum(struct compiler *c);
+
+static void parse_primary(struct compiler *c)
+{
+  char name[16];
+  const char *begin;
+  char *end;
+  size_t len, i;
+  int args;
+
+  skip_space(c);
+  begin = c->p;
+  if (isdigit((unsigned char)*c->p) || *c->p == '.') {
+    double value = strtod(c->p, &end);
+    if (end == c->p) {
+      fail(c, "Invalid number");
+      return;
+    }
+    c->p = end;
+    push(c, OP_CONST, 0, 0, value);
+  } else if (isalpha((unsigned char)*c->p)) {
+    while (isalnum((unsigned char)*c->p) || *c->p == '_') ++c->p;
+    len = MIN((size_t)(c->p - begin), sizeof(name) - 1);
+    memcpy(name, begin, len);
+    name[len] = '\0';
+
+    if (accept(c, '(')) {
+      for (i = 0; i < sizeof(funcs) / sizeof(funcs[0]); ++i) {
+        if (!strcmp(funcs[i].name, name)) break;
+      }
+      if (i == sizeof(funcs) / sizeof(funcs[0])) {
+        c->p = begin;
+        fail(c, "Unknown function");
+        return;
+      }
+      for (args = 0; args < funcs[i].args && !c->failed; ++args) {
+        if (args > 0) expect(c, ',');
+        parse_sum(c);
+      }
+      expect(c, ')');
+      apply(c, funcs[i].op, funcs[i].args);
+    } else {
+      for (i = 0; i < sizeof(vars) / sizeof(vars[0]); ++i) {
+        if (!strcmp(vars[i].name, name)) break;
+      }
+      if (i == sizeof(vars) / sizeof(vars[0])) {
+        c->p = begin;
+        fail(c, "Unknown variable");
+        return;
+      }
+      switch (vars[i].var) {
+        case VAR_X: case VAR_DX:
+          push(c, OP_VAR, DEP_COL, vars[i].var, 0.0);
+          break;
+        case VAR_DIST: case VAR_ANGLE:
+          push(c, OP_VAR, DEP_ROW | DEP_COL, vars[i].var, 0.0);
+          break;
+        case VAR_Y: case VAR_DY:
+          push(c, OP_VAR, DEP_ROW, vars[i].var, 0.0);
+          break;
+        default:
+          push(c, OP_VAR, 0, vars[i].var, 0.0);
+          break;
+      }
+    }
+  } else if (accept(c, '(')) {
+    parse_sum(c);
+    expect(c, ')');
+  } else {
+    fail(c, "Expected a number, variable or '('");
+  }
+}
+
+static void parse_unary(struct compiler *c)
+{
+  if (accept(c, '-')) {
+    parse_unary(c);
+    apply(c, OP_NEG, 1);
+  } else if (accept(c, '+')) {
+    parse_unary(c);
+  } else {
+    parse_primary(c);
+  }
+}
+
+static void parse_product(struct compiler *c)
+{
+  parse_unary(c);
+  while (!c->failed) {
+    if (accept(c, '*')) {
+      parse_unary(c);
+      apply(c, OP_MUL, 2);
+    } else if (accept(c, '/')) {
+      parse_unary(c);
+      apply(c, OP_DIV, 2);
+    } else {
+      break;
+    }
+  }
+}
+
+static void parse_sum(struct compiler *c)
+{
+  parse_product(c);
+  while (!c->failed) {
+    if (accept(c, '+')) {
+      parse_product(c);
+      apply(c, OP_ADD, 2);
+    } else if (accept(c, '-')) {
+      parse_product(c);
+      apply(c, OP_SUB, 2);
+    } else {
+      break;
+    }
+  }
+}
+
+/* Returns the largest number of values on the stack while code runs */
+static int code_depth(const struct insn *code, int len)
+{
+  int i, sp = 0, depth = 0;
+
+  for (i = 0; i < len; ++i) {
+    if (code[i].op <= OP_COLUMN) {
+      ++sp;
+      depth = MAX(depth, sp);
+    } else if (code[i].op >= OP_ADD) {
+      --sp;
+    }
+  }
+  return depth;
+}
+
+struct expr *expr_compile(const char *text, char *error, size_t error_size)
+{
+  struct compiler c;
+  int i;
+
+  memset(&c, 0, sizeof(c));
+  c.text = c.p = text;
+  c.error = error;
+  c.error_size = error_size;
+  c.e = calloc(1, sizeof(struct expr));
+  if (c.e == NULL) {
+    snprintf(error, error_size, "Out of memory");
+    return NULL;
+  }
+
+  parse_sum(&c);
+  skip_space(&c);
+  if (*c.p != '\0') fail(&c, "Unexpected character");
+  if (c.failed) {
+    free(c.e);
+    return NULL;
+  }
+
+  /* A formula only depending on x is one column term */
+  hoist(&c, 0);
+  c.e->vary = (c.stack[0].dep & DEP_COL) != 0;
+
+  c.e->depth = code_depth(c.e->code, c.e->len);
+  for (i = 0; i < c.e->num_cols; ++i) {
+    int first = i > 0 ? c.e->col_end[i - 1] : 0;
+    c.e->depth = MAX(c.e->depth, code_depth(c.e->cols + first, c.e->col_end[i] - first));
+  }
+  return c.e;
+}
+
+void expr_free(struct expr *e)
+{
+  free(e);
+}
+
+int expr_scratch_rows(const struct expr *e)
+{
+  return MAX(e->depth - 1, 0);
+}
+
+int expr_columns(const struct expr *e)
+{
+  return e->num_cols;
+}
+
+int expr_cost(const struct expr *e)
+{
+  /* Base cost of the polar field and palette fitting, then per instruction
+   * working on whole rows. Instructions done once per row cost nothing.
+   * Weights were fitted to acidwarp-bench -x timings of formulas.txt.
+   */
+  int i, cost = 3;
+
+  for (i = 0; i < e->len; ++i) {
+    if (!e->code[i].vary) continue;
+    switch (e->code[i].op) {
+      case OP_SIN: case OP_COS: cost += 4; break;
+      case OP_DIST: case OP_ANGLE: cost += 3; break;
+      case OP_FMOD: cost += 8; break;
+      case OP_XOR: cost += 2; break;
+      default: cost += 1; break;
+    }
+  }
+  return cost;
+}
+
+/* Evaluation */
+
+#define F_ADD(a, b) ((a) + (b))
+#define F_SUB(a, b) ((a) - (b))
+#define F_MUL(a, b) ((a) * (b))
+#define F_DIV(a, b) ((a) / (b))
+#define F_FMOD(a, b) fmod(a, b)
+#define F_XOR(a, b) ((int)(a) ^ (int)(b))
+#define F_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define F_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* Applies f to every sample, where at least one operand varies */
+#define BINARY(f)                                                    \
+  if (in->vary == (VARY_A | VARY_B)) {                               \
+    for (i = 0; i < n; ++i) dst[i] = f(a[i], b[i]);                  \
+  } else if (in->vary == VARY_A) {                                   \
+    for (i = 0; i < n; ++i) dst[i] = f(a[i], sb);                    \
+  } else {                                                           \
+    for (i = 0; i < n; ++i) dst[i] = f(sa, b[i]);                    \
+  }                                                                  \
+  break
+
+/* Runs code for n samples. The value at stack depth 0 goes to out, and
+ * deeper values go to rows of scratch. Terms of columns, like those of
+ * rows, take sin and cos from libm, as the built in functions do. So do
+ * sines of values computed from dist(), like the rings of the built in
+ * functions around moved centres.
+ */
+static void run(const struct insn *code, int len, const struct expr_vars *v,
+                const double *columns, size_t stride,
+                double *scratch, double *out, int n, int vary, int exact)
+{
+  struct {
+    const double *v;
+    double s;
+    int dist;                   /* computed from dist() */
+  } st[EXPR_MAX_DEPTH];
+  const double *a, *b;
+  double sa, sb, *dst;
+  int k, i, sp = 0, dist_b;
+
+  for (k = 0; k < len; ++k) {
+    const struct insn *in = &code[k];
+
+    if (in->op <= OP_COLUMN) {
+      if (in->op == OP_CONST) {
+        st[sp].s = in->value;
+      } else if (in->op == OP_COLUMN) {
+        st[sp].v = columns + in->arg * stride;
+      } else {
+        switch (in->arg) {
+          case VAR_X: st[sp].v = v->x; break;
+          case VAR_DX: st[sp].v = v->dx; break;
+          case VAR_DIST: st[sp].v = v->dist; break;
+          case VAR_ANGLE: st[sp].v = v->angle; break;
+          case VAR_Y: st[sp].s = v->y; break;
+          case VAR_DY: st[sp].s = v->dy; break;
+          case VAR_WIDTH: st[sp].s = v->width; break;
+          case VAR_HEIGHT: st[sp].s = v->height; break;
+          default: st[sp].s = v->offsets[in->arg - VAR_OFFSETS]; break;
+        }
+      }
+      st[sp].dist = 0;
+      ++sp;
+      continue;
+    }
+
+    b = NULL;
+    sb = 0.0;
+    dist_b = 0;
+    if (in->op >= OP_ADD) {
+      --sp;
+      b = st[sp].v;
+      sb = st[sp].s;
+      dist_b = st[sp].dist;
+    }
+    a = st[sp - 1].v;
+    sa = st[sp - 1].s;
+    dst = sp > 1 ? scratch + (size_t)(sp - 2) * n : out;
+    if (!in->vary) {
+      st[sp - 1].s = scalar_op(in->op, sa, sb);
+      st[sp - 1].dist = 0;
+      continue;
+    }
+
+    switch (in->op) {
+      case OP_NEG: for (i = 0; i < n; ++i) dst[i] = -a[i]; break;
+      case OP_INT: for (i = 0; i < n; ++i) dst[i] = (int)a[i]; break;
+      case OP_ABS: for (i = 0; i < n; ++i) dst[i] = fabs(a[i]); break;
+      case OP_SIN:
+        if (exact || st[sp - 1].dist) {
+          for (i = 0; i < n; ++i) dst[i] = lut_sin(a[i]);
+        } else {
+          lut_sin_v(a, dst, n);
+        }
+        break;
+      case OP_COS:
+        if (exact) {
+          for (i = 0; i < n; ++i) dst[i] = lut_cos(a[i]);
+        } else {
+          lut_cos_v(a, dst, n);
+        }
+        break;
+      case OP_ADD: BINARY(F_ADD);
+      case OP_SUB: BINARY(F_SUB);
+      case OP_MUL: BINARY(F_MUL);
+      case OP_DIV: BINARY(F_DIV);
+      case OP_FMOD: BINARY(F_FMOD);
+      case OP_XOR: BINARY(F_XOR);
+      case OP_MIN: BINARY(F_MIN);
+      case OP_MAX: BINARY(F_MAX);
+      case OP_DIST:
+      case OP_ANGLE:
+        if (in->vary == VARY_A) {
+          if (in->op == OP_DIST) lut_dist_v(a, sb, dst, n);
+          else lut_angle_v(a, sb, dst, n);
+        } else {
+          /* The vector functions take a single dy */
+          for (i = 0; i < n; ++i) {
+            const double *pa = (in->vary & VARY_A) ? &a[i] : &sa;
+            if (in->op == OP_DIST) lut_dist_v(pa, b[i], &dst[i], 1);
+            else lut_angle_v(pa, b[i], &dst[i], 1);
+          }
+        }
+        break;
+    }
+    st[sp - 1].v = dst;
+    if (in->op == OP_SIN || in->op == OP_COS) st[sp - 1].dist = 0;
+    else st[sp - 1].dist = in->op == OP_DIST || st[sp - 1].dist || dist_b;
+  }
+
+  if (!vary) {
+    for (i = 0; i < n; ++i) out[i] = st[0].s;
+  } else if (st[0].v != out) {
+    memcpy(out, st[0].v, n * sizeof(double));
+  }
+}
+
+void expr_eval_columns(const struct expr *e, const struct expr_vars *v,
+                       double *columns, double *scratch, int n)
+{
+  int i, first;
+
+  for (i = 0; i < e->num_cols; ++i) {
+    first = i > 0 ? e->col_end[i - 1] : 0;
+    run(e->cols + first, e->col_end[i] - first, v, NULL, 0,
+        scratch, columns + (size_t)i * n, n, 1, 1);
+  }
+}
+
+void expr_eval(const struct expr *e, const struct expr_vars *v,
+               const double *columns, size_t stride,
+               double *scratch, double *out, int n)
+{
+  run(e->code, e->len, v, columns, stride, scratch, out, n, e->vary, 0);
+}
+
+/* Loaded formulas */
+
+static struct {
+  struct expr *e;
+  int builtin;
+} loaded[EXPR_MAX_LOADED];
+static int num_loaded = 0;
+
+int expr_load(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  char line[1024], error[128];
+  char *text, *end;
+  int line_num = 0, count = 0, builtin;
+  struct expr *e;
+
+  if (f == NULL) {
+    fprintf(stderr, "Couldn't open %s\n", path);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    ++line_num;
+    line[strcspn(line, "\r\n")] = '\0';
+    for (text = line; isspace((unsigned char)*text); ++text);
+    if (*text == '\0' || *text == '#') continue;
+
+    builtin = -1;
+    if (isdigit((unsigned char)*text)) {
+      long num = strtol(text, &end, 10);
+      while (isspace((unsigned char)*end)) ++end;
+      if (*end == ':') {
+        builtin = (int)num;
+        text = end + 1;
+      }
+    }
+
+    if (num_loaded >= EXPR_MAX_LOADED) {
+      fprintf(stderr, "%s:%d: Too many formulas\n", path, line_num);
+      break;
+    }
+    e = expr_compile(text, error, sizeof(error));
+    if (e == NULL) {
+      fprintf(stderr, "%s:%d: %s\n", path, line_num, error);
+      continue;
+    }
+    loaded[num_loaded].e = e;
+    loaded[num_loaded].builtin = builtin;
+    ++num_loaded;
+    ++count;
+  }
+
+  fclose(f);
+  return count;
+}
+
+int expr_count(void)
+{
+  return num_loaded;
+}
+
+const struct expr *expr_get(int i)
+{
+  return loaded[i].e;
+}
+
+int expr_builtin(int i)
+{
+  return loaded[i].builtin;
+}
@@ -0,0 +1,82 @@
+/* EXPR.H */
+
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stddef.h>
+
+/* Image functions written as formulas, like
+ *
+ *   angle + sin(dist * 10) / 64 + cos(2 * x * 255 / width) / 32
+ *
+ * Formulas are compiled to a small bytecode, and every instruction works
+ * on a whole row of samples at a time, using the same vector lut functions
+ * as the built in image functions. Terms which only depend on x are only
+ * computed once per image, and terms which only depend on y once per row.
+ *
+ * Variables:
+ *   x, y            coordinates, like those of the built in functions
+ *   dx, dy          relative to the centre
+ *   dist, angle     lut_dist (dx, dy) and lut_angle (dx, dy)
+ *   width, height   image size in the same coordinates
+ *   x1..x4, y1..y4  random offsets from -20 to 19, new for every image
+ * Operators: + - * / and parentheses
+ * Functions: sin(a), cos(a), dist(dx, dy), angle(dx, dy), the lut functions
+ *   of img_float.h; fmod(a, b), int(a) truncating like a cast, xor(a, b) of
+ *   int(a) and int(b), abs(a), min(a, b), max(a, b)
+ */
+struct expr;
+
+/* Inputs of a formula for a row of n samples */
+struct expr_vars {
+  const double *x, *dx;         /* per sample */
+  const double *dist, *angle;   /* per sample */
+  double y, dy;
+  double width, height;
+  double offsets[8];            /* x1..x4, y1..y4 */
+};
+
+/* Compiles a formula. On error, returns NULL and describes the error. */
+struct expr *expr_compile(const char *text, char *error, size_t error_size);
+void expr_free(struct expr *e);
+
+/* Rows of n values of scratch memory needed by expr_eval() and
+ * expr_eval_columns()
+ */
+int expr_scratch_rows(const struct expr *e);
+/* Number of terms which only depend on x */
+int expr_columns(const struct expr *e);
+/* Relative cost per pixel, in the units of generate_image_info() */
+int expr_cost(const struct expr *e);
+
+/* Computes the terms which only depend on x for a whole row of n samples.
+ * Term i goes to columns + i * n. Only x and dx of v are used.
+ */
+void expr_eval_columns(const struct expr *e, const struct expr_vars *v,
+                       double *columns, double *scratch, int n);
+
+/* Computes the formula for n samples. columns are the terms computed by
+ * expr_eval_columns(), starting at the first of these samples, with stride
+ * values from one term to the next.
+ */
+void expr_eval(const struct expr *e, const struct expr_vars *v,
+               const double *columns, size_t stride,
+               double *scratch, double *out, int n);
+
+/* Formulas loaded by expr_load() are drawn as image functions
+ * FIRST_FORMULA_FUNCTION onwards.
+ */
+
+/* Loads formulas from a text file, one per line. Empty lines and lines
+ * starting with # are skipped. A formula may start with "number:", naming
+ * the built in function it reproduces, which acidwarp-bench compares it
+ * against. Errors are printed to stderr and skip that line. Returns the
+ * number of formulas loaded, or -1 if the file could not be read.
+ */
+int expr_load(const char *path);
+int expr_count(void);
+const struct expr *expr_get(int i);
+/* Returns the built in function formula i reproduces, or -1 */
+int expr_builtin(int i);
+
+#endif /* EXPR_H */
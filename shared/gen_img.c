@@ -1,8 +1,16 @@
 #pragma ide diagnostic ignored "cert-msc50-cpp"
+#include <limits.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
 #include "handy.h"
 #include "acidwarp.h"
 #include "img_float.h"
+#include "expr.h"
+#include "gen_pool.h"
+#include "polar.h"
+#include "rng.h"
 
 /* ACID WARP (c)Copyright 1992, 1993 by Noah Spurrier
  * All Rights reserved. Private Proprietary Source Code by Noah Spurrier
@@ -11,397 +19,2288 @@
  * Ported to Android, iOS / iPadOS, macOS, Linux, Windows by Matthew Zavislak
  */
 
-void generate_image_float(int imageFuncNum,
-                          UCHAR *buf_graf,
-                          UINT _xcenter,
-                          UINT _ycenter,
-                          UINT _width,
-                          UINT _height,
-                          UINT colors,
-                          UINT pitch,
-                          UINT normalize)
+/* gen_img_f32.c compiles this file again with GEN_FLOAT32 defined, which
+ * gives generate_image_float32(), doing all math in single precision with
+ * twice as many values per vector. Colors are truncated to a palette index
+ * in the end, so for most functions this changes few or no pixels.
+ */
+#ifdef GEN_FLOAT32
+typedef float gen_t;
+#define lut_sin_v lut_sin_vf
+#define lut_cos_v lut_cos_vf
+#define lut_angle_v lut_angle_vf
+#define lut_dist_v lut_dist_vf
+#define polar_field_get polar_field_get_float
+#define FIELD(name) name ## _f
+#define GEN_ENGINE generate_image_float32
+#define GEN_JOB generate_job_float32
+#else
+typedef double gen_t;
+#define FIELD(name) name
+#define GEN_ENGINE generate_image_double
+#define GEN_JOB generate_job_double
+#endif
+
+/* Rows are generated in bands of this many rows, which may be drawn in
+ * parallel by the generator thread pool.
+ */
+#define GEN_BAND_ROWS 16
+
+/* Adaptive refinement draws bands of this many blocks of rows */
+#define GEN_ADAPTIVE_BLOCKS 8
+/* Blocks are interpolated where the colors of lattice rows bend by at most
+ * this many palette indices. Any interpolation error moves the pixels near
+ * a palette index boundary across it, so it is kept small. At 2, functions
+ * 5 and 17 changed up to 1.9% and 12% of pixels.
+ */
+#define GEN_ADAPTIVE_BEND 0.02
+
+/* Scratch rows available to row kernels */
+#define GEN_TMP_ROWS 6
+
+/* Samples per unit of distance or angle in profile tables. Linear
+ * interpolation between them is off by well under 0.001 of a palette
+ * index for the functions using them.
+ */
+#define GEN_PROFILE_STEPS 32
+/* Profile samples drawn at a time while building the table */
+#define GEN_PROFILE_CHUNK 1024
+
+/* Centres of functions summing rings around several centres are at most
+ * this far from the image centre
+ */
+#define GEN_CENTRE_OFFSET 20
+/* The wide distance field for them is only used if its margin is at most
+ * this part of the image size, so it stays about as large as the image
+ */
+#define GEN_WIDE_MAX_MARGIN 8
+
+/* Neighbour dependent functions need the finished pixels to the left and
+ * above. Their bands still run in parallel, because each band crosses the
+ * image in blocks of this many columns, and only starts a block once the
+ * band above has finished it. The bands then advance as a diagonal
+ * wavefront. Each row is still drawn left to right with its own random
+ * state, so the image does not depend on the number of threads.
+ */
+#define GEN_BLOCK_COLS 128
+
+/* Set by generate_set_fraction(), which is shared by both engines */
+extern UCHAR *gen_fraction;
+/* Set by generate_set_adaptive(), and the result of the last image */
+extern UINT gen_adaptive;
+extern int gen_adaptive_all;
+extern double gen_evaluated;
+
+struct gen_args {
+  int imageFuncNum;
+  UCHAR *buf_graf;
+  UCHAR *frac_graf;             /* fraction of every index, or NULL */
+  UINT _width, _height;
+  UINT colors, pitch, normalize;
+  UINT _xcenter, _ycenter;
+  UINT step, rows, cols;        /* pixels per sample, rows and columns of samples */
+  UINT mirror;                  /* GEN_MIRROR_X and GEN_MIRROR_Y used for this image */
+  const struct polar_field *pf;
+  gen_t x1,x2,x3,x4,y1,y2,y3,y4;
+  UINT seed;
+  UINT tmp_rows;                /* scratch rows available to row kernels */
+  const struct expr *expr;      /* formula functions: the formula */
+  const double *expr_columns;   /* and its terms which only depend on x */
+  const gen_t *waves;          /* cos_wave_x() of every wave, per column */
+  const gen_t *profile;        /* profile functions: color per sample */
+  const UCHAR *profile_index;   /* and the palette index between samples */
+  UINT profile_len;             /* samples in profile, without the last */
+  const gen_t *dist_wide;      /* ring functions: the wide distance field, or NULL */
+  double wide_scale_x, wide_scale_y; /* its pixels per unit of offset */
+  UINT adaptive;                /* block size of adaptive refinement, or 0 */
+  UINT band_rows;               /* rows per band of generate_band() */
+  SDL_AtomicInt *counts;        /* pixels it evaluated, and would draw without it */
+  gen_t *edges;                /* neighbour functions: last row of each band */
+  SDL_AtomicInt *edge_done;     /* samples finished in each of those rows */
+  UINT edge_bands;              /* bands with a row in edges, see edge_slot() */
+};
+
+/* Everything a row kernel needs to know about the row being generated */
+struct gen_row {
+  const struct gen_args *a;
+  UINT n;                       /* samples in the row */
+  UINT x0;                      /* first sample, if only part of the row is drawn */
+  int _y;
+  gen_t y, dy;
+  const gen_t *x, *dx;         /* per column */
+  const gen_t *dist, *angle;   /* per pixel in this row */
+  gen_t *tmp[GEN_TMP_ROWS];
+  gen_t *line;                 /* neighbour functions: this row */
+  const gen_t *above;          /* the row above, or NULL for the first row */
+  struct rng rng;
+};
+
+/* Random numbers used while drawing come from a state which is seeded
+ * per row from the image seed. This way the image does not depend on
+ * which thread drew which rows.
+ */
+static void row_seed(struct rng *r, UINT seed, int y)
+{
+  rng_seed(r, seed ^ ((UINT)y * 0x85EBCA6Bu));
+}
+
+/* Fit color value into the palette range using modulo.  It seems
+   that the Turbo-C MOD function does not behave the way I expect.
+   It gives negative values for the MOD of a negative number.
+   I expect MOD to function as it does on my HP-28S.
+ */
+static inline UCHAR quantize(gen_t color, UINT colors)
+{
+  ULONG _color;
+
+  /* Final colors need to go from 1 to colors, because color 0 is
+   * not used. Floating point conversion to the palette is by
+   * truncation, not rounding, as if each whole number is a bin
+   * (0 for 0 to 1, 1 for 1 to 2 and so on). 1 is added later,
+   * so right here this requires: 0 <= color < colors
+   */
+  _color = (long)color % (colors-1);
+  /* The -1.0 < color < 0 bin is mapped to the last bin,
+   * meaning right before the 0 <= color < 1 bin in rotation.
+   */
+  if (color < 0)
+    _color += (colors - 2);
+
+  ++_color;
+  /* color 0 is never used, so all colors are from 1 through 255 */
+  return (UCHAR)_color;
+}
+
+static void quantize_row(const gen_t *color, UCHAR *out, UINT n, UINT colors)
+{
+  UINT _x;
+
+  /* Constant modulus for the usual palette size is much faster */
+  if (colors == 256) {
+    for (_x = 0; _x < n; ++_x) out[_x] = quantize(color[_x], 256);
+  } else {
+    for (_x = 0; _x < n; ++_x) out[_x] = quantize(color[_x], colors);
+  }
+}
+
+/* quantize() of a color whose truncation to an integer is t */
+static inline UCHAR quantize_int(int t, int negative, UINT colors)
+{
+  return (UCHAR)(t % (int)(colors - 1) + (negative ? (int)colors - 1 : 1));
+}
+
+/* quantize_row() of the colors v, or of v / 2 if halved */
+static void quantize_int_row(const int *v, int halved, UCHAR *out, UINT n,
+                             UINT colors)
+{
+  UINT _x;
+
+  if (colors == 256 && halved) {
+    for (_x = 0; _x < n; ++_x)
+      out[_x] = quantize_int(v[_x] / 2, v[_x] < 0, 256);
+  } else if (colors == 256) {
+    for (_x = 0; _x < n; ++_x)
+      out[_x] = quantize_int(v[_x], v[_x] < 0, 256);
+  } else {
+    for (_x = 0; _x < n; ++_x)
+      out[_x] = quantize_int(halved ? v[_x] / 2 : v[_x], v[_x] < 0, colors);
+  }
+}
+
+/* Part of the way from the palette index of color to the next, in 1/256
+ * of an index, for shading smoothly between palette entries
+ */
+static inline UCHAR fraction(gen_t color)
+{
+  /* Adding this leaves no bits for a fraction, so it rounds to a whole
+   * number without a libm call, and the loop below vectorizes.
+   */
+  const gen_t round_magic = sizeof(gen_t) == sizeof(float) ?
+                            (gen_t)12582912.0f : (gen_t)6755399441055744.0;
+  gen_t f = color - ((color + round_magic) - round_magic);
+  int _f;
+
+  /* Rounded up, so the fraction is from the whole number below */
+  f += (gen_t)(f < 0);
+  _f = (int)(f * 256);
+  return (UCHAR)MIN(_f, 255);
+}
+
+static void fraction_row(const gen_t *color, UCHAR *out, UINT n)
+{
+  UINT _x;
+
+  for (_x = 0; _x < n; ++_x) out[_x] = fraction(color[_x]);
+}
+
+/* Helpers for terms shared by many functions. Terms which only depend on
+ * y or on x are computed once per row or column, in double precision with
+ * libm like the original generator. A last bit differing there would move
+ * a palette index boundary along a whole row or column of pixels.
+ */
+
+static double sin1(double a)
+{
+  return lut_sin(a);
+}
+
+static double cos1(double a)
+{
+  return lut_cos(a);
+}
+
+/* y of the row, which gen_t may round */
+static double row_y(const struct gen_row *r)
+{
+  const struct polar_field *pf = r->a->pf;
+  return pf->y != NULL ? pf->y[r->_y] : polar_y(pf, r->_y);
+}
+
+/* out = lut_sin (in * k) */
+static void sin_of(const gen_t *in, gen_t k, gen_t *out, UINT n)
+{
+  UINT _x;
+  for (_x = 0; _x < n; ++_x) out[_x] = in[_x] * k;
+  lut_sin_v(out, out, n);
+}
+
+/* Sets pixels to the whole number of pixels an offset o moves a centre
+ * by, at scale pixels per unit of offset. Returns 0 if it is not a whole
+ * number, or too far for the margin of the wide distance field.
+ */
+static int whole_pixels(gen_t o, double scale, int *pixels)
+{
+  double p = o * scale;
+  *pixels = (int)floor(p + 0.5);
+  return fabs(p - *pixels) < 1e-6 &&
+         abs(*pixels) <= (int)ceil(GEN_CENTRE_OFFSET * scale);
+}
+
+/* sin_of() for distances computed per row rather than read from the polar
+ * field, from moved centres or stretched. Their rings put palette index
+ * boundaries where the vector functions and libm disagree in the last
+ * bit, so double precision uses libm like the original generator.
+ */
+static void sin_dist_of(const gen_t *in, gen_t k, gen_t *out, UINT n)
+{
+#ifdef GEN_FLOAT32
+  sin_of(in, k, out, n);
+#else
+  UINT _x;
+  for (_x = 0; _x < n; ++_x) out[_x] = sin1(in[_x] * k);
+#endif
+}
+
+/* out = lut_sin (lut_dist (dx + ox, dy + oy) * k) */
+static void sin_dist_at(const struct gen_row *r, gen_t ox, gen_t oy,
+                        gen_t k, gen_t *out)
+{
+  const struct gen_args *a = r->a;
+  int sx, sy;
+  UINT _x;
+
+  /* The distance from a centre moved by whole pixels is that of another
+   * pixel from the image centre
+   */
+  if (a->dist_wide != NULL && whole_pixels(ox, a->wide_scale_x, &sx) &&
+      whole_pixels(oy, a->wide_scale_y, &sy)) {
+    const struct polar_field *pf = a->pf;
+    size_t row = (size_t)(r->_y + sy + (int)pf->margin_y) *
+                 (pf->_width + 2 * pf->margin_x);
+    sin_dist_of(a->dist_wide + row + (int)(r->x0 + pf->margin_x) + sx,
+                k, out, r->n);
+    return;
+  }
+  for (_x = 0; _x < r->n; ++_x) out[_x] = r->dx[_x] + ox;
+  lut_dist_v(out, r->dy + oy, out, r->n);
+  sin_dist_of(out, k, out, r->n);
+}
+
+/* Frequencies of the 2D waves used by image functions. Function 17 also
+ * takes lut_sin of the WAVE_2 columns.
+ */
+enum { WAVE_1, WAVE_2, WAVE_7, WAVE_11, WAVE_17, NUM_WAVES,
+       SIN_WAVE_2 = NUM_WAVES, NUM_WAVE_COLUMNS };
+static const double wave_k[NUM_WAVES] = { 1, 2, 7, 11, 17 };
+
+/* lut_cos (k * x * ANGLE_UNIT / width) for every column. These only depend
+ * on x, so they are computed once per image by column_waves().
+ */
+static const gen_t *cos_wave_x(const struct gen_row *r, int wave)
+{
+  return r->a->waves + wave * (size_t)r->a->cols + r->x0;
+}
+
+/* lut_cos (k * y * ANGLE_UNIT / height) */
+static double cos_wave_y(const struct gen_row *r, int wave)
+{
+  return cos1(wave_k[wave] * row_y(r) * ANGLE_UNIT / r->a->pf->height);
+}
+
+/* dist and angle with dy stretched vertically by 2 */
+static void stretched_polar(const struct gen_row *r, gen_t *dist, gen_t *angle)
+{
+  const gen_t dy = (r->y - r->a->pf->y_center) * 2;
+  lut_dist_v(r->dx, dy, dist, r->n);
+  lut_angle_v(r->dx, dy, angle, r->n);
+}
+
+/* Row kernels, one per image function. Each computes the unquantized
+ * color of every pixel in a row.
+ */
+
+static void func_0(struct gen_row *r, gen_t *color)   /* Rays plus 2D Waves */
+{
+  gen_t *s = r->tmp[0];
+  const gen_t *cx = cos_wave_x(r, WAVE_2);
+  gen_t cy = cos_wave_y(r, WAVE_2);
+  UINT _x;
+  sin_of(r->dist, 10, s, r->n);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = r->angle[_x] + s[_x] / 64 + cx[_x] / 32 + cy / 32;
+}
+
+static void func_1(struct gen_row *r, gen_t *color)   /* Rays plus 2D Waves */
+{
+  gen_t *s = r->tmp[0];
+  const gen_t *cx = cos_wave_x(r, WAVE_2);
+  gen_t cy = cos_wave_y(r, WAVE_2);
+  UINT _x;
+  sin_of(r->dist, 10, s, r->n);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = r->angle[_x] + s[_x] / 16 + cx[_x] / 8 + cy / 8;
+}
+
+/* Sum of sines of the distance from four randomly offset centres */
+static void sum_offset_rings(struct gen_row *r, gen_t *color,
+                             gen_t k1, gen_t k2, gen_t k3, gen_t k4,
+                             gen_t div)
+{
+  const struct gen_args *a = r->a;
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1], *s3 = r->tmp[2], *s4 = r->tmp[3];
+  UINT _x;
+  sin_dist_at(r, a->x1, a->y1, k1, s1);
+  sin_dist_at(r, a->x2, a->y2, k2, s2);
+  sin_dist_at(r, a->x3, a->y3, k3, s3);
+  sin_dist_at(r, a->x4, a->y4, k4, s4);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = s1[_x] / div + s2[_x] / div + s3[_x] / div + s4[_x] / div;
+}
+
+static void func_2(struct gen_row *r, gen_t *color)
+{
+  sum_offset_rings(r, color, 4, 8, 16, 32, 32);
+}
+
+static void func_3(struct gen_row *r, gen_t *color)   /* Peacock */
+{
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1];
+  UINT _x;
+  sin_dist_at(r, 20, 0, 10, s1);
+  sin_dist_at(r, -20, 0, 10, s2);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = r->angle[_x] + s1[_x] / 32 + r->angle[_x] + s2[_x] / 32;
+}
+
+static void func_4(struct gen_row *r, gen_t *color)
+{
+  UINT _x;
+  sin_of(r->dist, 1, color, r->n);
+  for (_x = 0; _x < r->n; ++_x) color[_x] = color[_x] / 16;
+}
+
+static void func_5(struct gen_row *r, gen_t *color)   /* 2D Wave + Spiral */
+{
+  gen_t *s = r->tmp[0];
+  const gen_t *cx = cos_wave_x(r, WAVE_1);
+  gen_t cy = cos_wave_y(r, WAVE_1);
+  UINT _x;
+  sin_of(r->dist, 1, s, r->n);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = cx[_x] / 8 + cy / 8 + r->angle[_x] + s[_x] / 32;
+}
+
+/* Sines of the distance from three fixed centres */
+static void three_centres(struct gen_row *r, gen_t k,
+                          gen_t *s1, gen_t *s2, gen_t *s3)
+{
+  sin_dist_at(r, 0, -20, k, s1);
+  sin_dist_at(r, 20, 20, k, s2);
+  sin_dist_at(r, -20, 20, k, s3);
+}
+
+static void func_6(struct gen_row *r, gen_t *color)   /* Peacock, three centers */
+{
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1], *s3 = r->tmp[2];
+  UINT _x;
+  three_centres(r, 4, s1, s2, s3);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = s1[_x] / 32 + s2[_x] / 32 + s3[_x] / 32;
+}
+
+static void func_7(struct gen_row *r, gen_t *color)   /* Peacock, three centers */
+{
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1], *s3 = r->tmp[2];
+  UINT _x;
+  three_centres(r, 8, s1, s2, s3);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = r->angle[_x] + s1[_x] / 32 + s2[_x] / 32 + s3[_x] / 32;
+}
+
+static void func_8(struct gen_row *r, gen_t *color)   /* Peacock, three centers */
+{
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1], *s3 = r->tmp[2];
+  UINT _x;
+  three_centres(r, 12, s1, s2, s3);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = s1[_x] / 32 + s2[_x] / 32 + s3[_x] / 32;
+}
+
+static void func_9(struct gen_row *r, gen_t *color)   /* Five Arm Star */
+{
+  gen_t *s = r->tmp[0];
+  UINT _x;
+  sin_of(r->angle, 5, s, r->n);
+  for (_x = 0; _x < r->n; ++_x) color[_x] = r->dist[_x] + s[_x] / 64;
+}
+
+static void func_10(struct gen_row *r, gen_t *color)  /* 2D Wave */
+{
+  const gen_t *cx = cos_wave_x(r, WAVE_2);
+  gen_t cy = cos_wave_y(r, WAVE_2);
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x) color[_x] = cx[_x] / 4 + cy / 4;
+}
+
+static void func_11(struct gen_row *r, gen_t *color)  /* 2D Wave */
+{
+  const gen_t *cx = cos_wave_x(r, WAVE_1);
+  gen_t cy = cos_wave_y(r, WAVE_1);
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x) color[_x] = cx[_x] / 8 + cy / 8;
+}
+
+static void func_12(struct gen_row *r, gen_t *color)  /* Simple Concentric Rings */
+{
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x) color[_x] = r->dist[_x];
+}
+
+/* Good for testing proper wrapping of angle. This was
+ * flawed in original Acidwarp 4.10, resulting in a
+ * double-width stripe going right from the centre.
+ */
+static void func_13(struct gen_row *r, gen_t *color)  /* Simple Rays */
+{
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x) color[_x] = r->angle[_x];
+}
+
+/* Good for testing proper wrapping of negative color.
+ * Errors will show as a dashed seam going right from centre.
+ */
+static void func_14(struct gen_row *r, gen_t *color)  /* Toothed Spiral Sharp */
+{
+  gen_t *s = r->tmp[0];
+  UINT _x;
+  sin_of(r->dist, 8, s, r->n);
+  for (_x = 0; _x < r->n; ++_x) color[_x] = r->angle[_x] + s[_x] / 32;
+}
+
+static void func_15(struct gen_row *r, gen_t *color)  /* Rings with sine */
+{
+  UINT _x;
+  sin_of(r->dist, 4, color, r->n);
+  for (_x = 0; _x < r->n; ++_x) color[_x] = color[_x] / 32;
+}
+
+static void func_16(struct gen_row *r, gen_t *color)  /* Rings with sine with sliding inner Rings */
+{
+  gen_t *s = r->tmp[0];
+  UINT _x;
+  sin_of(r->dist, 4, s, r->n);
+  for (_x = 0; _x < r->n; ++_x) color[_x] = r->dist[_x] + s[_x] / 32;
+}
+
+static void func_17(struct gen_row *r, gen_t *color)
+{
+  const gen_t *sx = cos_wave_x(r, SIN_WAVE_2);
+  gen_t sy = sin1(cos_wave_y(r, WAVE_2));
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = sx[_x] / (20 + r->dist[_x]) + sy / (20 + r->dist[_x]);
+}
+
+/* 2D Wave fading out with distance */
+static void fading_wave(struct gen_row *r, gen_t *color, int wave)
+{
+  const gen_t *cx = cos_wave_x(r, wave);
+  gen_t cy = cos_wave_y(r, wave);
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = cx[_x] / (20 + r->dist[_x]) + cy / (20 + r->dist[_x]);
+}
+
+static void func_18(struct gen_row *r, gen_t *color)  /* 2D Wave */
+{
+  fading_wave(r, color, WAVE_7);
+}
+
+static void func_19(struct gen_row *r, gen_t *color)  /* 2D Wave */
+{
+  fading_wave(r, color, WAVE_17);
+}
+
+static void func_20(struct gen_row *r, gen_t *color)  /* 2D Wave Interference */
+{
+  const gen_t *cx = cos_wave_x(r, WAVE_17);
+  gen_t cy = cos_wave_y(r, WAVE_17);
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = cx[_x] / 32 + cy / 32 + r->dist[_x] + r->angle[_x];
+}
+
+static void func_21(struct gen_row *r, gen_t *color)  /* 2D Wave Interference */
+{
+  const gen_t *cx = cos_wave_x(r, WAVE_7);
+  gen_t cy = cos_wave_y(r, WAVE_7);
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = cx[_x] / 32 + cy / 32 + r->dist[_x];
+}
+
+static void func_22(struct gen_row *r, gen_t *color)  /* 2D Wave Interference */
+{
+  const gen_t *cx7 = cos_wave_x(r, WAVE_7), *cx11 = cos_wave_x(r, WAVE_11);
+  gen_t cy7 = cos_wave_y(r, WAVE_7), cy11 = cos_wave_y(r, WAVE_11);
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = cx7[_x] / 32 + cy7 / 32 + cx11[_x] / 32 + cy11 / 32;
+}
+
+static void func_23(struct gen_row *r, gen_t *color)
+{
+  UINT _x;
+  sin_of(r->angle, 7, color, r->n);
+  for (_x = 0; _x < r->n; ++_x) color[_x] = color[_x] / 32;
+}
+
+static void func_24(struct gen_row *r, gen_t *color)
+{
+  sum_offset_rings(r, color, 2, 4, 6, 8, 12);
+}
+
+static void func_25(struct gen_row *r, gen_t *color)
+{
+  const struct gen_args *a = r->a;
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1], *s3 = r->tmp[2], *s4 = r->tmp[3];
+  UINT _x;
+  sin_dist_at(r, a->x1, a->y1, 2, s1);
+  sin_dist_at(r, a->x2, a->y2, 4, s2);
+  sin_dist_at(r, a->x3, a->y3, 6, s3);
+  sin_dist_at(r, a->x4, a->y4, 8, s4);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = r->angle[_x] + s1[_x] / 16 +
+                r->angle[_x] + s2[_x] / 16 +
+                s3[_x] /  8 +
+                s4[_x] /  8;
+}
+
+static void func_26(struct gen_row *r, gen_t *color)
+{
+  const struct gen_args *a = r->a;
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1], *s3 = r->tmp[2], *s4 = r->tmp[3];
+  UINT _x;
+  sin_dist_at(r, a->x1, a->y1, 2, s1);
+  sin_dist_at(r, a->x2, a->y2, 4, s2);
+  sin_dist_at(r, a->x3, a->y3, 6, s3);
+  sin_dist_at(r, a->x4, a->y4, 8, s4);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = r->angle[_x] + s1[_x] / 12 +
+                r->angle[_x] + s2[_x] / 12 +
+                r->angle[_x] + s3[_x] / 12 +
+                r->angle[_x] + s4[_x] / 12;
+}
+
+static void func_27(struct gen_row *r, gen_t *color)
+{
+  sum_offset_rings(r, color, 2, 4, 6, 8, 32);
+}
+
+static void func_30(struct gen_row *r, gen_t *color)
+{
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1], *s3 = r->tmp[2];
+  UINT _x;
+  three_centres(r, 4, s1, s2, s3);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = (((int)s1[_x] / 32 ^
+                  (int)s2[_x] / 32) ^
+                 (int)s3[_x] / 32);
+}
+
+static void func_31(struct gen_row *r, gen_t *color)
+{
+  UINT _x;
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = ((int)fmod(r->angle[_x], (ANGLE_UNIT/4)) ^ (int)r->dist[_x]);
+}
+
+/* Whole coordinates of the plaid functions, truncated from dx and dy * k
+ * in double precision. Rounded to gen_t first, a coordinate just below a
+ * whole number could become it, which would move a whole row or column.
+ */
+static int whole_dy(const struct gen_row *r, int k)
+{
+  return (int)((row_y(r) - r->a->pf->y_center) * k);
+}
+
+static void whole_dx(const struct gen_row *r, int *dx)
+{
+  const struct polar_field *pf = r->a->pf;
+  UINT i, _x;
+
+  for (i = 0; i < r->n; ++i) {
+    _x = (r->x0 + i) * r->a->step;
+    dx[i] = (int)(pf->dx != NULL ? pf->dx[_x] : polar_x(pf, _x) - pf->x_center);
+  }
+}
+
+static void func_32(struct gen_row *r, gen_t *color)  /* Plaid (Useful for aspect ratio verification) */
+{
+  int *dx = (int *)r->tmp[0];
+  const int dy = whole_dy(r, 1);
+  UINT _x;
+  whole_dx(r, dx);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = (dy ^ dx[_x]);
+}
+
+static void func_35(struct gen_row *r, gen_t *color)
+{
+  gen_t *s = r->tmp[0], *dist2 = r->tmp[1], *angle2 = r->tmp[2];
+  UINT _x;
+  sin_of(r->dist, 8, s, r->n);
+  stretched_polar(r, dist2, angle2);
+  for (_x = 0; _x < r->n; ++_x) color[_x] = r->angle[_x] + s[_x] / 32;
+  sin_dist_of(dist2, 8, s, r->n);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = (color[_x] + angle2[_x] + s[_x] / 32) / 2;
+}
+
+static void func_36(struct gen_row *r, gen_t *color)
+{
+  gen_t *s = r->tmp[0], *dist2 = r->tmp[1], *angle2 = r->tmp[2];
+  const gen_t *cx = cos_wave_x(r, WAVE_2);
+  gen_t cy = cos_wave_y(r, WAVE_2);
+  UINT _x;
+  sin_of(r->dist, 10, s, r->n);
+  stretched_polar(r, dist2, angle2);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = r->angle[_x] + s[_x] / 16 + cx[_x] / 8 + cy / 8;
+  sin_dist_of(dist2, 8, s, r->n);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = (color[_x] + angle2[_x] + s[_x] / 32) / 2;
+}
+
+static void func_37(struct gen_row *r, gen_t *color)
+{
+  gen_t *s = r->tmp[0], *dist2 = r->tmp[1], *angle2 = r->tmp[2];
+  const gen_t *cx = cos_wave_x(r, WAVE_2);
+  gen_t cy = cos_wave_y(r, WAVE_2);
+  UINT _x;
+  sin_of(r->dist, 10, s, r->n);
+  stretched_polar(r, dist2, angle2);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = r->angle[_x] + s[_x] / 16 + cx[_x] / 8 + cy / 8;
+  sin_dist_of(dist2, 10, s, r->n);
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = (color[_x] + angle2[_x] + s[_x] / 16 +
+                 cx[_x] / 8 + cy / 8) / 2;
+}
+
+/* Intent is to interlace two different screens */
+static void func_38(struct gen_row *r, gen_t *color)
+{
+  const gen_t *dist = r->dist, *angle = r->angle;
+  gen_t *s = r->tmp[0];
+  UINT _x;
+  if (r->_y % 2) {
+    gen_t *dist2 = r->tmp[1], *angle2 = r->tmp[2];
+    lut_dist_v(r->dx, r->dy * 2, dist2, r->n);
+    lut_angle_v(r->dx, r->dy * 2, angle2, r->n);
+    dist = dist2;
+    angle = angle2;
+    sin_dist_of(dist, 8, s, r->n);
+  } else {
+    sin_of(dist, 8, s, r->n);
+  }
+  for (_x = 0; _x < r->n; ++_x) color[_x] = angle[_x] + s[_x] / 32;
+}
+
+static void func_39(struct gen_row *r, gen_t *color)
+{
+  gen_t *dist2 = r->tmp[0], *angle2 = r->tmp[1];
+  UINT _x;
+  stretched_polar(r, dist2, angle2);
+  for (_x = 0; _x < r->n; ++_x) {
+    color[_x] = ((int)fmod(r->angle[_x], (ANGLE_UNIT/4)) ^ (int)r->dist[_x]);
+    color[_x] = (color[_x] +  (((int)fmod(angle2[_x], (ANGLE_UNIT/4)) ^ (int)dist2[_x]))) / 2;
+  }
+}
+
+static void func_40(struct gen_row *r, gen_t *color)
+{
+  int *dx = (int *)r->tmp[0];
+  const int dy = whole_dy(r, 1), dy2 = whole_dy(r, 2);
+  UINT _x;
+  whole_dx(r, dx);
+  for (_x = 0; _x < r->n; ++_x) {
+    color[_x] = (dy ^ dx[_x]);
+    color[_x] = (color[_x] +  (dy2 ^ dx[_x])) / 2;
+  }
+}
+
+static void func_41(struct gen_row *r, gen_t *color)  /* 12-fold Mandala Symmetry #claude */
+{
+  gen_t *s = r->tmp[0], *c = r->tmp[1];
+  UINT _x;
+  sin_of(r->dist, 8, s, r->n);
+  for (_x = 0; _x < r->n; ++_x) c[_x] = r->dist[_x] * 3;
+  lut_cos_v(c, c, r->n);
+  for (_x = 0; _x < r->n; ++_x) {
+    gen_t sym_angle = fmod(r->angle[_x] * 6, ANGLE_UNIT/2);
+    if (sym_angle > ANGLE_UNIT/4) sym_angle = ANGLE_UNIT/2 - sym_angle;
+    color[_x] = sym_angle * 4 + s[_x] / 32 + c[_x] / 64;
+  }
+}
+
+#ifndef GEN_FLOAT32
+static void expr_vars_image(const struct gen_args *a, struct expr_vars *v)
+{
+  v->width = a->pf->width;
+  v->height = a->pf->height;
+  v->offsets[0] = a->x1; v->offsets[1] = a->x2;
+  v->offsets[2] = a->x3; v->offsets[3] = a->x4;
+  v->offsets[4] = a->y1; v->offsets[5] = a->y2;
+  v->offsets[6] = a->y3; v->offsets[7] = a->y4;
+}
+
+/* Formula loaded by expr_load() */
+static void func_expr(struct gen_row *r, gen_t *color)
+{
+  struct expr_vars v;
+
+  expr_vars_image(r->a, &v);
+  v.x = r->x;
+  v.dx = r->dx;
+  v.dist = r->dist;
+  v.angle = r->angle;
+  v.y = r->y;
+  v.dy = r->dy;
+  expr_eval(r->a->expr, &v, r->a->expr_columns + r->x0, r->a->cols,
+            r->tmp[0], color, r->n);
+}
+#endif
+
+static void func_random(struct gen_row *r, gen_t *color)
+{
+  UINT _x;
+#ifdef GEN_FLOAT32
+  for (_x = 0; _x < r->n; ++_x)
+    color[_x] = (gen_t)rng_double(&r->rng, r->a->colors - 1);
+#else
+  rng_fill(&r->rng, r->a->colors - 1, color, r->n);
+#endif
+  for (_x = 0; _x < r->n; ++_x) color[_x] += 1;
+}
+
+/* Integer kernels of the functions whose color is an integer made by XOR,
+ * or half of one with GEN_HALVED. They compute that integer with integer
+ * math instead, which quantize_int_row() turns into the same palette
+ * indices as the color kernel. The row length is read once, as v could
+ * otherwise alias it, which keeps the loops from being vectorized.
+ * Truncating makes any rounding difference a whole palette index, so
+ * functions 30, 31 and 39, which truncate distances and angles, are drawn
+ * in double precision. Functions 32 and 40 take their coordinates from
+ * double precision in both, see whole_dx().
+ */
+
+static void int_30(struct gen_row *r, int *v)
+{
+  gen_t *s1 = r->tmp[0], *s2 = r->tmp[1], *s3 = r->tmp[2];
+  const UINT n = r->n;
+  UINT _x;
+  three_centres(r, 4, s1, s2, s3);
+  for (_x = 0; _x < n; ++_x)
+    v[_x] = ((int)s1[_x] / 32 ^ (int)s2[_x] / 32) ^ (int)s3[_x] / 32;
+}
+
+/* (int)fmod (a, ANGLE_UNIT/4). As ANGLE_UNIT/4 is 255/4, scaling by 4
+ * makes the modulus a whole number, and the fraction of a * 4 can't carry
+ * into the whole part when divided by 4 again.
+ */
+static inline int angle_quarter(gen_t a)
+{
+  return (int)(a * 4) % 255 / 4;
+}
+
+static void int_31(struct gen_row *r, int *v)
+{
+  const UINT n = r->n;
+  UINT _x;
+  for (_x = 0; _x < n; ++_x)
+    v[_x] = angle_quarter(r->angle[_x]) ^ (int)r->dist[_x];
+}
+
+static void int_32(struct gen_row *r, int *v)
+{
+  const int dy = whole_dy(r, 1);
+  const UINT n = r->n;
+  UINT _x;
+  whole_dx(r, v);
+  for (_x = 0; _x < n; ++_x) v[_x] ^= dy;
+}
+
+static void int_39(struct gen_row *r, int *v)
+{
+  gen_t *dist2 = r->tmp[0], *angle2 = r->tmp[1];
+  const UINT n = r->n;
+  UINT _x;
+  stretched_polar(r, dist2, angle2);
+  for (_x = 0; _x < n; ++_x)
+    v[_x] = (angle_quarter(r->angle[_x]) ^ (int)r->dist[_x]) +
+            (angle_quarter(angle2[_x]) ^ (int)dist2[_x]);
+}
+
+static void int_40(struct gen_row *r, int *v)
+{
+  const int dy = whole_dy(r, 1), dy2 = whole_dy(r, 2);
+  const UINT n = r->n;
+  UINT _x;
+  whole_dx(r, v);
+  for (_x = 0; _x < n; ++_x) {
+    const int dx = v[_x];
+    v[_x] = (dy ^ dx) + (dy2 ^ dx);
+  }
+}
+
+/* Neighbour dependent kernels draw samples x0 to x1 of a row. They read
+ * the finished pixels to the left and above from working rows of palette
+ * indices, so they quantize and store each pixel there themselves.
+ */
+
+static void func_28(struct gen_row *r, UINT x0, UINT x1)  /* Random Curtain of Rain (in strong wind) */
 {
+  UINT _x;
+  double color;
+  for (_x = x0; _x < x1; ++_x) {
+    if (r->above == NULL || _x == 0)
+      color = rng_double(&r->rng, 16);
+    else
+      color = (r->line[_x-1] + r->above[_x]) / 2.0
+              + rng_double(&r->rng, 16) - 8;
+    r->line[_x] = quantize(color, r->a->colors);
+  }
+}
+
+static void func_29(struct gen_row *r, UINT x0, UINT x1)
+{
+  UINT _x;
+  double color;
+  for (_x = x0; _x < x1; ++_x) {
+    if (r->above == NULL || _x == 0)
+      color = rng_double(&r->rng, 1024);
+    else
+      color = r->dist[_x]/6 + (r->line[_x-1] + r->above[_x]) / 2.0
+              + rng_double(&r->rng, 16) - 8;
+    r->line[_x] = quantize(color, r->a->colors);
+  }
+}
+
+static void func_33(struct gen_row *r, UINT x0, UINT x1)  /* Variation on Rain */
+{
+  UINT _x;
+  double color;
+  for (_x = x0; _x < x1; ++_x) {
+    if (r->above == NULL || _x == 0)
+      color = rng_double(&r->rng, 16);
+    else
+      color = (r->line[_x-1] + r->above[_x]) / 2.0;
+
+    color += rng_double(&r->rng, 2) - 1;
+
+    if (color < 64)
+      color += rng_double(&r->rng, 16) - 8;
+    r->line[_x] = quantize(color, r->a->colors);
+  }
+}
+
+static void func_34(struct gen_row *r, UINT x0, UINT x1)  /* Variation on Rain */
+{
+  UINT _x;
+  double color;
+  for (_x = x0; _x < x1; ++_x) {
+    if (r->above == NULL || _x == 0)
+      color = rng_double(&r->rng, 16);
+    else
+      color = (r->line[_x-1] + r->above[_x]) / 2.0;
+
+    if (color < 100)
+      color += rng_double(&r->rng, 16) - 8;
+    r->line[_x] = quantize(color, r->a->colors);
+  }
+}
+
+/* gen_func flags */
+#define GEN_WAVES 1             /* uses cos_wave_x() */
+/* Mirror symmetric about the vertical or horizontal axis through the centre.
+ * Only pixels on one side of the axis are computed, and the rest are copied.
+ * Rotational symmetry like that of function 41 does not map pixels onto
+ * pixels, so only mirror axes are used.
+ */
+#define GEN_MIRROR_X 2
+#define GEN_MIRROR_Y 4
+#define GEN_MIRROR_XY (GEN_MIRROR_X | GEN_MIRROR_Y)
+/* Drawn in double precision. Other functions change at most 0.16% of
+ * pixels in single precision, as measured by acidwarp-bench -V at every
+ * default resolution, scaled and unscaled, so generate_image_float() uses
+ * generate_image_float32() for them. The rain functions feed each pixel
+ * into the next, so any difference spreads, and they do not use the vector
+ * functions which single precision speeds up. The XOR functions which
+ * truncate distances and angles would change whole palette indices.
+ */
+#define GEN_DOUBLE 8
+#define GEN_RANDOM 16           /* draws random numbers for every pixel */
+/* Only depends on the distance or the angle, so every image is drawn from
+ * a profile table of it, see build_profile().
+ */
+#define GEN_PROFILE_DIST 32
+#define GEN_PROFILE_ANGLE 64
+#define GEN_PROFILE (GEN_PROFILE_DIST | GEN_PROFILE_ANGLE)
+/* Sums rings around centres GEN_CENTRE_OFFSET away, or around the random
+ * offsets, which is faster with the wide distance field, see use_wide().
+ */
+#define GEN_CENTRES 128
+#define GEN_OFFSET_CENTRES 256
+#define GEN_HALVED 512          /* integer kernel returns twice the color */
+/* Drawn faster by adaptive refinement, which changes few pixels, as
+ * measured by acidwarp-bench -B. Not for neighbour or random functions.
+ * No built in function qualifies: within GEN_ADAPTIVE_BEND, the smoothest,
+ * 5 and 17, still evaluate 68% to all of their pixels, and are no faster.
+ */
+#define GEN_ADAPTIVE 1024
+
+/* Image functions, indexed by imageFuncNum. Exactly one of the color and
+ * neighbour kernels is set. Functions with an integer kernel also have a
+ * color kernel, for the fractions of smooth shading.
+ */
+static const struct gen_func {
+  void (*color)(struct gen_row *r, gen_t *color);
+  void (*neighbour)(struct gen_row *r, UINT x0, UINT x1);
+  UINT flags;
+  void (*integer)(struct gen_row *r, int *v);
+} gen_funcs[] = {
+  { .color = func_0, .flags = GEN_WAVES },
+  { .color = func_1, .flags = GEN_WAVES },
+  { .color = func_2, .flags = GEN_OFFSET_CENTRES },
+  { .color = func_3, .flags = GEN_CENTRES },
+  { .color = func_4, .flags = GEN_MIRROR_XY | GEN_PROFILE_DIST },
+  { .color = func_5, .flags = GEN_WAVES },
+  { .color = func_6, .flags = GEN_MIRROR_X | GEN_CENTRES },
+  { .color = func_7, .flags = GEN_CENTRES },
+  { .color = func_8, .flags = GEN_MIRROR_X | GEN_CENTRES },
+  { .color = func_9, .flags = GEN_MIRROR_X },
+  { .color = func_10, .flags = GEN_WAVES },
+  { .color = func_11, .flags = GEN_WAVES },
+  { .color = func_12, .flags = GEN_MIRROR_XY | GEN_PROFILE_DIST },
+  { .color = func_13, .flags = GEN_PROFILE_ANGLE },
+  { .color = func_14 },
+  { .color = func_15, .flags = GEN_MIRROR_XY | GEN_PROFILE_DIST },
+  { .color = func_16, .flags = GEN_MIRROR_XY | GEN_PROFILE_DIST },
+  { .color = func_17, .flags = GEN_WAVES },
+  { .color = func_18, .flags = GEN_WAVES },
+  { .color = func_19, .flags = GEN_WAVES },
+  { .color = func_20, .flags = GEN_WAVES },
+  { .color = func_21, .flags = GEN_WAVES },
+  { .color = func_22, .flags = GEN_WAVES },
+  { .color = func_23, .flags = GEN_MIRROR_X | GEN_PROFILE_ANGLE },
+  { .color = func_24, .flags = GEN_OFFSET_CENTRES },
+  { .color = func_25, .flags = GEN_OFFSET_CENTRES },
+  { .color = func_26, .flags = GEN_OFFSET_CENTRES },
+  { .color = func_27, .flags = GEN_OFFSET_CENTRES },
+  { .neighbour = func_28, .flags = GEN_DOUBLE | GEN_RANDOM },
+  { .neighbour = func_29, .flags = GEN_DOUBLE | GEN_RANDOM },
+  { .color = func_30, .flags = GEN_MIRROR_X | GEN_CENTRES | GEN_DOUBLE,
+    .integer = int_30 },
+  { .color = func_31, .flags = GEN_DOUBLE, .integer = int_31 },
+  { .color = func_32, .integer = int_32 },
+  { .neighbour = func_33, .flags = GEN_DOUBLE | GEN_RANDOM },
+  { .neighbour = func_34, .flags = GEN_DOUBLE | GEN_RANDOM },
+  { .color = func_35 },
+  { .color = func_36, .flags = GEN_WAVES },
+  { .color = func_37, .flags = GEN_WAVES },
+  { .color = func_38 },
+  { .color = func_39, .flags = GEN_DOUBLE | GEN_HALVED, .integer = int_39 },
+  { .color = func_40, .flags = GEN_HALVED, .integer = int_40 },
+  { .color = func_41, .flags = GEN_MIRROR_XY }
+};
+#define NUM_GEN_FUNCS ((int)(sizeof(gen_funcs) / sizeof(gen_funcs[0])))
+
+static const struct gen_func random_func = {
+  .color = func_random, .flags = GEN_DOUBLE | GEN_RANDOM
+};
+
+static const struct gen_func *get_func(int imageFuncNum)
+{
+#ifndef GEN_FLOAT32
+  static const struct gen_func expr_func = {
+    .color = func_expr, .flags = GEN_DOUBLE
+  };
+  if (imageFuncNum >= FIRST_FORMULA_FUNCTION &&
+      imageFuncNum - FIRST_FORMULA_FUNCTION < expr_count()) return &expr_func;
+#endif
+  if (imageFuncNum < 0 || imageFuncNum >= NUM_GEN_FUNCS) return &random_func;
+  return &gen_funcs[imageFuncNum];
+}
+
+/* Sample position in the profile table of the pixels of a row */
+static const gen_t *profile_in(const struct gen_row *r)
+{
+  return (get_func(r->a->imageFuncNum)->flags & GEN_PROFILE_ANGLE) ?
+         r->angle : r->dist;
+}
+
+/* Draws pixels of a profile function by interpolating its profile table */
+static void profile_color(struct gen_row *r, gen_t *color)
+{
+  const gen_t *in = profile_in(r);
+  const gen_t *p = r->a->profile;
+  const int last = (int)r->a->profile_len - 1;
+  UINT _x;
+
+  for (_x = 0; _x < r->n; ++_x) {
+    gen_t t = in[_x] * GEN_PROFILE_STEPS;
+    int i = MIN((int)t, last);
+    color[_x] = p[i] + (t - i) * (p[i + 1] - p[i]);
+  }
+}
+
+/* Same as profile_color() followed by quantize_row(), but takes the palette
+ * index straight from the table wherever it is the same all the way to the
+ * next sample, which is most of the image.
+ */
+static void profile_row(const struct gen_row *r, UCHAR *out)
+{
+  const gen_t *in = profile_in(r);
+  const gen_t *p = r->a->profile;
+  const UCHAR *index = r->a->profile_index;
+  const int last = (int)r->a->profile_len - 1;
+  const UINT colors = r->a->colors;
+  UINT _x;
+
+  for (_x = 0; _x < r->n; ++_x) {
+    gen_t t = in[_x] * GEN_PROFILE_STEPS;
+    int i = MIN((int)t, last);
+    out[_x] = index[i] != 0 ? index[i] :
+              quantize(p[i] + (t - i) * (p[i + 1] - p[i]), colors);
+  }
+}
+
+/* Largest distance from the centre in the image, which is at a corner */
+static double max_dist(const struct polar_field *pf)
+{
+  double dx = MAX(fabs(polar_x(pf, 0) - pf->x_center),
+                  fabs(polar_x(pf, pf->_width - 1) - pf->x_center));
+  double dy = MAX(fabs(polar_y(pf, 0) - pf->y_center),
+                  fabs(polar_y(pf, pf->_height - 1) - pf->y_center));
+  return sqrt(dx * dx + dy * dy);
+}
+
+/* A profile table being built, see profile_begin() */
+struct gen_profile {
+  gen_t *table;
+  gen_t *samples;               /* distances or angles of a chunk, and scratch */
+  UCHAR *index;
+  UINT len, next;               /* samples in table, without the last, and done */
+};
+
+/* Functions of the distance or angle alone are computed once for every
+ * sample along it, by running their own kernel on the samples. Pixels are
+ * then drawn from the table, which replaces their trig per pixel. Between
+ * two samples whose colors are in the same palette bin, interpolated colors
+ * are too, so the bin is stored for profile_row(), or 0 if they are not.
+ * Allocates the table, which profile_chunk() then fills. Returns 0 if out
+ * of memory.
+ */
+static int profile_begin(const struct gen_args *a, struct gen_profile *p)
+{
+  const struct gen_func *func = get_func(a->imageFuncNum);
+  double range = (func->flags & GEN_PROFILE_ANGLE) ? ANGLE_UNIT_2 :
+                 max_dist(a->pf);
+
+  p->len = (UINT)(range * GEN_PROFILE_STEPS) + 2;
+  p->next = 0;
+  p->table = malloc((p->len + 1) * sizeof(gen_t));
+  p->samples = malloc((GEN_TMP_ROWS + 1) * GEN_PROFILE_CHUNK * sizeof(gen_t));
+  p->index = malloc(p->len);
+  return p->table != NULL && p->samples != NULL && p->index != NULL;
+}
+
+/* Evaluates the next GEN_PROFILE_CHUNK samples of the table. Returns 1 once
+ * every sample and the palette bins are done.
+ */
+static int profile_chunk(const struct gen_args *a, struct gen_profile *p)
+{
+  const UINT n = MIN(p->len + 1 - p->next, GEN_PROFILE_CHUNK);
+  struct gen_row r;
+  UINT i;
+  int t;
+
+  for (t = 0; t < GEN_TMP_ROWS; ++t) {
+    r.tmp[t] = p->samples + (t + 1) * GEN_PROFILE_CHUNK;
+  }
+  r.a = a;
+  r.x0 = 0;
+  r.n = n;
+  r.dist = r.angle = p->samples;
+  for (t = 0; t < (int)n; ++t) {
+    p->samples[t] = (gen_t)(p->next + t) / GEN_PROFILE_STEPS;
+  }
+  get_func(a->imageFuncNum)->color(&r, p->table + p->next);
+  p->next += n;
+  if (p->next <= p->len) return 0;
+
+  for (i = 0; i < p->len; ++i) {
+    gen_t c0 = p->table[i], c1 = p->table[i + 1];
+    p->index[i] = (long)c0 == (long)c1 && (c0 < 0) == (c1 < 0) ?
+                  quantize(c0, a->colors) : 0;
+  }
+  return 1;
+}
+
+/* Ring functions read the distance from each centre out of the wide
+ * distance field instead of computing it, wherever the centre is moved by
+ * whole pixels. Returns 1 if that is the case for every centre, with the
+ * margins the field needs.
+ */
+static int use_wide(struct gen_args *a, UINT *margin_x, UINT *margin_y)
+{
+  const struct polar_field *pf = a->pf;
+  const gen_t offsets[8] = { a->x1, a->y1, a->x2, a->y2,
+                             a->x3, a->y3, a->x4, a->y4 };
+  int i, pixels;
+
+  /* Coarse previews have no field */
+  if (pf->FIELD(dist) == NULL) return 0;
+  a->wide_scale_x = pf->zoom * pf->_width / pf->width;
+  a->wide_scale_y = pf->zoom * pf->_height / pf->height;
+  if (!whole_pixels(GEN_CENTRE_OFFSET, a->wide_scale_x, &pixels) ||
+      !whole_pixels(GEN_CENTRE_OFFSET, a->wide_scale_y, &pixels)) return 0;
+  /* Live warp moves the random offsets by fractions of a pixel */
+  if (get_func(a->imageFuncNum)->flags & GEN_OFFSET_CENTRES) {
+    for (i = 0; i < 8; ++i) {
+      if (!whole_pixels(offsets[i], i % 2 ? a->wide_scale_y : a->wide_scale_x,
+                        &pixels)) return 0;
+    }
+  }
+
+  *margin_x = (UINT)ceil(GEN_CENTRE_OFFSET * a->wide_scale_x);
+  *margin_y = (UINT)ceil(GEN_CENTRE_OFFSET * a->wide_scale_y);
+  return *margin_x <= a->_width / GEN_WIDE_MAX_MARGIN &&
+         *margin_y <= a->_height / GEN_WIDE_MAX_MARGIN;
+}
+
+/* Fills the step x step block of every sample in a row of samples of
+ * buf, which is the image or its fractions
+ */
+static void expand_row(const struct gen_args *a, UCHAR *buf,
+                       const UCHAR *samples, int _y)
+{
+  UCHAR *dst = buf + (size_t)a->pitch * _y;
+  UINT i, _x, dy;
+
+  for (i = 0, _x = 0; _x < a->_width; ++i, _x += a->step) {
+    memset(dst + _x, samples[i], MIN(a->step, a->_width - _x));
+  }
+  for (dy = 1; dy < a->step && _y + dy < a->_height; ++dy) {
+    memcpy(dst + (size_t)a->pitch * dy, dst, a->_width);
+  }
+}
+
+/* Sets the x coordinates of r. If the polar field has none, they are
+ * computed into x and dx.
+ */
+static void set_columns(const struct gen_args *a, struct gen_row *r,
+                        gen_t *x, gen_t *dx)
+{
+  const struct polar_field *pf = a->pf;
+  UINT i, _x;
+
+  if (pf->FIELD(x) != NULL) {
+    r->x = pf->FIELD(x);
+    r->dx = pf->FIELD(dx);
+  } else {
+    for (i = 0, _x = 0; _x < a->_width; ++i, _x += a->step) {
+      x[i] = polar_x(pf, _x);
+      dx[i] = x[i] - pf->x_center;
+    }
+    r->x = x;
+    r->dx = dx;
+  }
+}
+
+/* Sets the y coordinate of r for pixel row _y, and the polar coordinates
+ * of samples x0 to x1. If the polar field has none, they are computed into
+ * dist and angle.
+ */
+static void set_row(const struct gen_args *a, struct gen_row *r, int _y,
+                    gen_t *dist, gen_t *angle, UINT x0, UINT x1)
+{
+  const struct polar_field *pf = a->pf;
+
+  r->_y = _y;
+  r->y = pf->y != NULL ? pf->y[_y] : polar_y(pf, _y);
+  r->dy = r->y - pf->y_center;
+
+  if (pf->FIELD(dist) != NULL) {
+    r->dist = pf->FIELD(dist) + (size_t)_y * a->_width;
+    r->angle = pf->FIELD(angle) + (size_t)_y * a->_width;
+  } else if (pf->dx != NULL) {
+    /* Too large to cache, but drawn the same */
+#ifdef GEN_FLOAT32
+    polar_field_row_float(pf, _y, x0, x1, dist, angle);
+#else
+    polar_field_row(pf, _y, x0, x1, dist, angle);
+#endif
+    r->dist = dist;
+    r->angle = angle;
+  } else {
+    lut_dist_v(r->dx + x0, r->dy, dist + x0, x1 - x0);
+    lut_angle_v(r->dx + x0, r->dy, angle + x0, x1 - x0);
+    r->dist = dist;
+    r->angle = angle;
+  }
+}
+
+/* Computes cos_wave_x() of every wave for n columns. Per pixel, this would
+ * cost the same trig calls on every row.
+ */
+static gen_t *column_waves(const struct gen_args *a, UINT n)
+{
+  const struct polar_field *pf = a->pf;
+  gen_t *waves = malloc(NUM_WAVE_COLUMNS * (size_t)n * sizeof(gen_t));
+  double x, c;
+  UINT i, _x;
+  int wave;
+
+  if (waves == NULL) return NULL;
+  for (i = 0, _x = 0; i < n; ++i, _x += a->step) {
+    x = pf->x != NULL ? pf->x[_x] : polar_x(pf, _x);
+    for (wave = 0; wave < NUM_WAVES; ++wave) {
+      c = cos1(wave_k[wave] * x * ANGLE_UNIT / pf->width);
+      waves[wave * (size_t)n + i] = c;
+      if (wave == WAVE_2) waves[SIN_WAVE_2 * (size_t)n + i] = sin1(c);
+    }
+  }
+  return waves;
+}
+
+#ifndef GEN_FLOAT32
+/* Computes the terms of a formula which only depend on x, for every
+ * column, like column_waves().
+ */
+static double *formula_columns(const struct gen_args *a)
+{
+  const struct polar_field *pf = a->pf;
+  const UINT n = a->cols;
+  const UINT terms = expr_columns(a->expr);
+  double *columns, *x, *dx;
+  struct expr_vars v;
+  UINT i, _x;
+
+  columns = malloc((terms + 2 + expr_scratch_rows(a->expr)) * (size_t)n * sizeof(double));
+  if (columns == NULL) return NULL;
+  x = columns + terms * (size_t)n;
+  dx = x + n;
+  for (i = 0, _x = 0; i < n; ++i, _x += a->step) {
+    if (pf->x != NULL) {
+      x[i] = pf->x[_x];
+      dx[i] = pf->dx[_x];
+    } else {
+      x[i] = polar_x(pf, _x);
+      dx[i] = x[i] - pf->x_center;
+    }
+  }
+
+  expr_vars_image(a, &v);
+  v.x = x;
+  v.dx = dx;
+  expr_eval_columns(a->expr, &v, columns, dx + n, n);
+  return columns;
+}
+#endif
+
+/* Returns the first pixel with a mirror image on the other side of
+ * centre. Pixels before it are too far from the centre for one.
+ */
+static UINT mirror_begin(UINT centre, UINT size)
+{
+  return 2 * centre >= size ? 2 * centre - size + 1 : 0;
+}
+
+/* Returns 1 if pixel row _y is copied from the mirror image row once all
+ * rows are drawn
+ */
+static int mirror_copied(const struct gen_args *a, int _y)
+{
+  return (a->mirror & GEN_MIRROR_Y) &&
+         (UINT)_y >= mirror_begin(a->_ycenter, a->_height) &&
+         (UINT)_y < a->_ycenter;
+}
 
-  int x1,x2,x3,x4,y1,y2,y3,y4;
+/* Draws samples x0 to x1 of a row into out, and their fractions into
+ * frac unless it is NULL
+ */
+static void draw_samples(const struct gen_func *func, struct gen_row *r,
+                         UINT x0, UINT x1, gen_t *color, UCHAR *out,
+                         UCHAR *frac)
+{
+  const gen_t *x = r->x, *dx = r->dx, *dist = r->dist, *angle = r->angle;
 
-  int _x, _y;
-  ULONG _color;
-  double x, y;
-  double dx, dy;
-  double dist, angle;
-  double color;
-  double x_center, y_center, width, height;
-
-  // Original DOS version targeted 8:5 display (320x200) but also supported 4:3 displays.
-  // It appears during the SDL port that added floating point conversion, it assumed a 8:5 display ratio.
-  // Apply the necessary correction here:
-  const double aspect_correction = (8.0 / 5.0) / ((double)_width / (double)_height);
-
-  if (normalize) {
-    x_center = (_xcenter * 320.0) / (double)_width;
-    y_center = (_ycenter * 200.0 * aspect_correction) / (double)_height;
-    width = 320.0;
-    height = 200.0 * aspect_correction;
+  r->x0 = x0;
+  r->n = x1 - x0;
+  r->x = x + x0;
+  r->dx = dx + x0;
+  r->dist = dist + x0;
+  r->angle = angle + x0;
+  if (r->a->profile != NULL && frac == NULL) {
+    profile_row(r, out + x0);
+  } else if (func->integer != NULL && frac == NULL) {
+    /* The color row has room for as many ints */
+    func->integer(r, (int *)color);
+    quantize_int_row((int *)color, func->flags & GEN_HALVED, out + x0, r->n,
+                     r->a->colors);
   } else {
-    x_center = _xcenter;
-    y_center = _ycenter;
-    width = _width;
-    height = _height;
+    func->color(r, color);
+    quantize_row(color, out + x0, r->n, r->a->colors);
+    if (frac != NULL) fraction_row(color, frac + x0, r->n);
   }
 
-  /* Some general purpose random angles and offsets.
-   * Not all functions use them.
+  r->x0 = 0;
+  r->n = r->a->cols;
+  r->x = x;
+  r->dx = dx;
+  r->dist = dist;
+  r->angle = angle;
+}
+
+static void generate_rows(const struct gen_args *a, int row_begin, int row_end)
+{
+  const struct gen_func profiled = { .color = profile_color };
+  const struct gen_func *func =
+    a->profile != NULL ? &profiled : get_func(a->imageFuncNum);
+  const UINT _width = a->_width;
+  const UINT n = a->cols;
+  const UINT xc = a->_xcenter;
+  struct gen_row r;
+  gen_t *scratch, *color, *x, *dx, *dist, *angle;
+  UCHAR *out, *frac = NULL, *samples = NULL;
+  int row, _y, i;
+  UINT _x, x_begin;
+
+  scratch = malloc((a->tmp_rows + 5) * (size_t)_width * sizeof(gen_t));
+  if (a->step > 1) {
+    /* Followed by the fractions of the samples */
+    samples = malloc(2 * n);
+  }
+  if (scratch == NULL || (a->step > 1 && samples == NULL)) {
+    free(scratch);
+    free(samples);
+    return;
+  }
+  for (i = 0; i < GEN_TMP_ROWS; ++i) {
+    r.tmp[i] = scratch + i * (size_t)_width;
+  }
+  /* Scratch rows follow each other, so kernels which need more than
+   * GEN_TMP_ROWS use them from r.tmp[0] onwards.
    */
+  color = scratch + a->tmp_rows * (size_t)_width;
+  x     = color + _width;
+  dx    = x + _width;
+  dist  = dx + _width;
+  angle = dist + _width;
 
-  x1 = RANDOM(40)-20;  x2 = RANDOM(40)-20;
-  x3 = RANDOM(40)-20;  x4 = RANDOM(40)-20;
-  y1 = RANDOM(40)-20;  y2 = RANDOM(40)-20;
-  y3 = RANDOM(40)-20;  y4 = RANDOM(40)-20;
+  r.a = a;
+  r.n = n;
+  r.x0 = 0;
+  r.line = NULL;
+  r.above = NULL;
+  set_columns(a, &r, x, dx);
 
-  for (_y = 0; _y < _height && !abort_draw; ++_y)
+  for (row = row_begin; row < row_end && !abort_draw; ++row)
   {
-    if (normalize) {
-      y = (double)(_y * 200 * aspect_correction) / _height;
+    _y = row * a->step;
+    if (mirror_copied(a, _y)) continue;
+
+    row_seed(&r.rng, a->seed, _y);
+    set_row(a, &r, _y, dist, angle, 0, n);
+
+    /* Samples go to a separate line before being expanded */
+    out = samples != NULL ? samples : a->buf_graf + (size_t)a->pitch * _y;
+    if (a->frac_graf != NULL) {
+      frac = samples != NULL ? samples + n :
+                               a->frac_graf + (size_t)a->pitch * _y;
+    }
+    if (a->mirror & GEN_MIRROR_X) {
+      x_begin = mirror_begin(xc, _width);
+      if (x_begin > 0) draw_samples(func, &r, 0, x_begin, color, out, frac);
+      draw_samples(func, &r, xc, n, color, out, frac);
+      for (_x = x_begin; _x < xc; ++_x) out[_x] = out[2 * xc - _x];
+      if (frac != NULL) {
+        for (_x = x_begin; _x < xc; ++_x) frac[_x] = frac[2 * xc - _x];
+      }
     } else {
-      y = _y;
+      draw_samples(func, &r, 0, n, color, out, frac);
     }
 
-    for (_x = 0; _x < _width; ++_x)
-    {
-      if (normalize) {
-        x = (double)(_x * 320) / _width;
-      } else {
-        x = _x;
+    if (samples != NULL) {
+      expand_row(a, a->buf_graf, samples, _y);
+      if (frac != NULL) expand_row(a, a->frac_graf, frac, _y);
+    }
+  }
+
+  free(samples);
+  free(scratch);
+}
+
+/* Adaptive refinement evaluates every a->adaptive-th row, the lattice
+ * rows, and divides the rows between them into blocks of a->adaptive
+ * columns. Where the lattice rows show that the colors along every column
+ * of a block are close to a straight line, the block is drawn by
+ * interpolating between the lattice rows above and below it. Other blocks
+ * are evaluated. Whole rows are evaluated instead of only the corners of
+ * blocks, so kernels reading per column tables need no changes.
+ */
+
+/* Computes the colors of the samples from x0 to x1 of row _y which are not
+ * copied from their mirror image into color + x0. Returns how many were
+ * computed.
+ */
+static UINT color_samples(const struct gen_func *func, struct gen_row *r,
+                          int _y, UINT x0, UINT x1, gen_t *color,
+                          gen_t *dist, gen_t *angle)
+{
+  const struct gen_args *a = r->a;
+  UINT begin[2], end[2], count = 0;
+  struct gen_row span;
+  int i, ranges = 1;
+
+  begin[0] = x0;
+  end[0] = x1;
+  if (a->mirror & GEN_MIRROR_X) {
+    /* Samples from mirror_begin() up to the centre are copied */
+    end[0] = MIN(x1, mirror_begin(a->_xcenter, a->_width));
+    begin[1] = MAX(x0, a->_xcenter);
+    end[1] = x1;
+    ranges = 2;
+  }
+  for (i = 0; i < ranges; ++i) {
+    if (begin[i] >= end[i]) continue;
+    set_row(a, r, _y, dist, angle, begin[i], end[i]);
+    span = *r;
+    span.x0 = begin[i];
+    span.n = end[i] - begin[i];
+    span.x = r->x + begin[i];
+    span.dx = r->dx + begin[i];
+    span.dist = r->dist + begin[i];
+    span.angle = r->angle + begin[i];
+    func->color(&span, color + begin[i]);
+    count += span.n;
+  }
+  return count;
+}
+
+/* Copies the colors of the samples with a mirror image from it */
+static void mirror_colors(const struct gen_args *a, gen_t *color)
+{
+  const UINT xc = a->_xcenter;
+  UINT _x;
+
+  if (!(a->mirror & GEN_MIRROR_X)) return;
+  for (_x = mirror_begin(xc, a->_width); _x < xc; ++_x) {
+    color[_x] = color[2 * xc - _x];
+  }
+}
+
+/* Quantizes a row of colors into pixel row _y of the image */
+static void store_colors(const struct gen_args *a, const gen_t *color, int _y)
+{
+  quantize_row(color, a->buf_graf + (size_t)a->pitch * _y, a->cols,
+               a->colors);
+  if (a->frac_graf != NULL) {
+    fraction_row(color, a->frac_graf + (size_t)a->pitch * _y, a->cols);
+  }
+}
+
+/* Returns the largest change of slope between three lattice rows, from
+ * column x0 to x1. Interpolating linearly next to the middle row is off by
+ * about an eighth of it.
+ */
+static gen_t lattice_bend(const gen_t *above, const gen_t *middle,
+                          const gen_t *below, UINT x0, UINT x1)
+{
+  gen_t bend = 0;
+  UINT _x;
+
+  for (_x = x0; _x < x1; ++_x) {
+    bend = MAX(bend, (gen_t)fabs(above[_x] - 2 * middle[_x] + below[_x]));
+  }
+  return bend;
+}
+
+static void generate_adaptive_rows(const struct gen_args *a,
+                                   int row_begin, int row_end)
+{
+  const struct gen_func profiled = { .color = profile_color };
+  const struct gen_func *func =
+    a->profile != NULL ? &profiled : get_func(a->imageFuncNum);
+  const UINT n = a->cols;
+  const UINT block = a->adaptive;
+  const UINT blocks = (n + block - 1) / block;
+  /* Rows after the last lattice row of the image are evaluated */
+  const int lattice = (MIN(row_end, (int)a->rows - 1) - row_begin) / block + 1;
+  UINT drawn_cols = n;
+  struct gen_row r;
+  gen_t *scratch, *x, *dx, *dist, *angle, *color, *lat, *bend;
+  UCHAR *smooth;
+  int k, _y, i, evaluated = 0, drawn = 0;
+  UINT bx, bx_end, x0, x1, _x;
+
+  /* Rows copied from their mirror image are next to each other */
+  if (mirror_copied(a, row_begin) && mirror_copied(a, row_end - 1)) return;
+
+  scratch = malloc(((a->tmp_rows + 5 + lattice) * (size_t)n +
+                    lattice * (size_t)blocks) * sizeof(gen_t) + blocks);
+  if (scratch == NULL) return;
+  for (i = 0; i < GEN_TMP_ROWS; ++i) {
+    r.tmp[i] = scratch + i * (size_t)n;
+  }
+  x     = scratch + a->tmp_rows * (size_t)n;
+  dx    = x + n;
+  dist  = dx + n;
+  angle = dist + n;
+  color = angle + n;
+  lat   = color + n;
+  bend  = lat + lattice * (size_t)n;
+  smooth = (UCHAR *)(bend + lattice * (size_t)blocks);
+
+  r.a = a;
+  r.n = n;
+  r.x0 = 0;
+  r.line = NULL;
+  r.above = NULL;
+  set_columns(a, &r, x, dx);
+  if (a->mirror & GEN_MIRROR_X) {
+    drawn_cols -= a->_xcenter - mirror_begin(a->_xcenter, a->_width);
+  }
+
+  for (k = 0; k < lattice && !abort_draw; ++k) {
+    evaluated += color_samples(func, &r, row_begin + k * block, 0, n,
+                               lat + k * (size_t)n, dist, angle);
+    mirror_colors(a, lat + k * (size_t)n);
+  }
+  for (k = 1; k + 1 < lattice; ++k) {
+    const gen_t *middle = lat + k * (size_t)n;
+    for (bx = 0; bx < blocks; ++bx) {
+      x0 = bx * block;
+      bend[k * blocks + bx] = lattice_bend(middle - n, middle, middle + n,
+                                           x0, MIN(x0 + block + 1, n));
+    }
+  }
+
+  /* The last lattice row is the first row of the next band, if any */
+  for (k = 0; row_begin + k * (int)block < row_end && !abort_draw; ++k) {
+    const int b0 = row_begin + k * block;
+    const int b1 = b0 + block;
+    const gen_t *top = lat + k * (size_t)n;
+    const gen_t *bottom = top + n;
+
+    if (!mirror_copied(a, b0)) {
+      store_colors(a, top, b0);
+      drawn += drawn_cols;
+    }
+    if (k + 1 == lattice) {
+      /* The last rows of the image have no lattice row below */
+      for (_y = b0 + 1; _y < row_end; ++_y) {
+        if (mirror_copied(a, _y)) continue;
+        evaluated += color_samples(func, &r, _y, 0, n, color, dist, angle);
+        mirror_colors(a, color);
+        store_colors(a, color, _y);
+        drawn += drawn_cols;
       }
-      dx = x - x_center;
-      /* dy may be altered below, so calculate here */
-      dy = y - y_center;
-
-      dist  = lut_dist (dx, dy);
-      angle = lut_angle (dx, dy);
-
-      /* select function. Could be made a separate function, but since
-         this function is evaluated over a large iteration of values I am
-         afraid that it might slow things down even more to have a
-         separate function.        */
-      switch (imageFuncNum)
-      {
-        case 0: /* Rays plus 2D Waves */
-          color = angle + lut_sin (dist * 10) / 64 +
-                  lut_cos (x * ANGLE_UNIT / width * 2) / 32 +
-                  lut_cos (y * ANGLE_UNIT / height * 2) / 32;
-          break;
-
-        case 1:        /* Rays plus 2D Waves */
-          color = angle + lut_sin (dist * 10) / 16 +
-                  lut_cos (x * ANGLE_UNIT / width * 2) / 8 +
-                  lut_cos (y * ANGLE_UNIT / height * 2) / 8;
-          break;
-
-        case 2:
-          color = lut_sin (lut_dist(dx + x1, dy + y1) *  4) / 32 +
-                  lut_sin (lut_dist(dx + x2, dy + y2) *  8) / 32 +
-                  lut_sin (lut_dist(dx + x3, dy + y3) * 16) / 32 +
-                  lut_sin (lut_dist(dx + x4, dy + y4) * 32) / 32;
-          break;
-
-        case 3:        /* Peacock */
-          color = angle + lut_sin (lut_dist(dx + 20, dy) * 10) / 32 +
-                  angle + lut_sin (lut_dist(dx - 20, dy) * 10) / 32;
-          break;
-
-        case 4:
-          color = lut_sin (dist) / 16;
-          break;
-
-        case 5:        /* 2D Wave + Spiral */
-          color = lut_cos (x * ANGLE_UNIT / width) / 8 +
-                  lut_cos (y * ANGLE_UNIT / height) / 8 +
-                  angle + lut_sin(dist) / 32;
-          break;
-
-        case 6:        /* Peacock, three centers */
-          color = lut_sin (lut_dist(dx,      dy - 20) * 4) / 32+
-                  lut_sin (lut_dist(dx + 20, dy + 20) * 4) / 32+
-                  lut_sin (lut_dist(dx - 20, dy + 20) * 4) / 32;
-          break;
-
-        case 7:        /* Peacock, three centers */
-          color = angle +
-                  lut_sin (lut_dist(dx,      dy - 20) * 8) / 32+
-                  lut_sin (lut_dist(dx + 20, dy + 20) * 8) / 32+
-                  lut_sin (lut_dist(dx - 20, dy + 20) * 8) / 32;
-          break;
-
-        case 8:        /* Peacock, three centers */
-          color = lut_sin (lut_dist(dx,      dy - 20) * 12) / 32+
-                  lut_sin (lut_dist(dx + 20, dy + 20) * 12) / 32+
-                  lut_sin (lut_dist(dx - 20, dy + 20) * 12) / 32;
-          break;
-
-        case 9:        /* Five Arm Star */
-          color = dist + lut_sin (5 * angle) / 64;
-          break;
-
-        case 10:        /* 2D Wave */
-          color = lut_cos (x * ANGLE_UNIT / width * 2) / 4 +
-                  lut_cos (y * ANGLE_UNIT / height * 2) / 4;
-          break;
-
-        case 11:        /* 2D Wave */
-          color = lut_cos (x * ANGLE_UNIT / width) / 8 +
-                  lut_cos (y * ANGLE_UNIT / height) / 8;
-          break;
-
-        case 12:        /* Simple Concentric Rings */
-          color = dist;
-          break;
-
-          /* Good for testing proper wrapping of angle. This was
-           * flawed in original Acidwarp 4.10, resulting in a
-           * double-width stripe going right from the centre.
-           */
-        case 13:        /* Simple Rays */
-          color = angle;
-          break;
-
-          /* Good for testing proper wrapping of negative color.
-           * Errors will show as a dashed seam going right from centre.
-           */
-        case 14:        /* Toothed Spiral Sharp */
-          color = angle + lut_sin(dist * 8)/32;
-          break;
-
-        case 15:        /* Rings with sine */
-          color = lut_sin(dist * 4)/32;
-          break;
-
-        case 16:        /* Rings with sine with sliding inner Rings */
-          color = dist+ lut_sin(dist * 4) / 32;
-          break;
-
-        case 17:
-          color = lut_sin(lut_cos(2 * x * ANGLE_UNIT / width)) / (20 + dist)
-                  + lut_sin(lut_cos(2 * y * ANGLE_UNIT / height)) / (20 + dist);
-          break;
-
-        case 18:        /* 2D Wave */
-          color = lut_cos(7 * x * ANGLE_UNIT / width)/(20 + dist) +
-                  lut_cos(7 * y * ANGLE_UNIT / height)/(20 + dist);
-          break;
-
-        case 19:        /* 2D Wave */
-          color = lut_cos(17 * x * ANGLE_UNIT/width)/(20 + dist) +
-                  lut_cos(17 * y * ANGLE_UNIT/height)/(20 + dist);
-          break;
-
-        case 20:        /* 2D Wave Interference */
-          color = lut_cos(17 * x * ANGLE_UNIT / width) / 32 +
-                  lut_cos(17 * y * ANGLE_UNIT / height) / 32 + dist + angle;
-          break;
-
-        case 21:        /* 2D Wave Interference */
-          color = lut_cos(7 * x * ANGLE_UNIT / width) / 32 +
-                  lut_cos(7 * y * ANGLE_UNIT / height) / 32 + dist;
-          break;
-
-        case 22:        /* 2D Wave Interference */
-          color = lut_cos( 7 * x * ANGLE_UNIT / width) / 32 +
-                  lut_cos( 7 * y * ANGLE_UNIT / height) / 32 +
-                  lut_cos(11 * x * ANGLE_UNIT / width) / 32 +
-                  lut_cos(11 * y * ANGLE_UNIT / height) / 32;
-          break;
-
-        case 23:
-          color = lut_sin (angle * 7) / 32;
-          break;
-
-        case 24:
-          color = lut_sin (lut_dist(dx + x1, dy + y1) * 2) / 12 +
-                  lut_sin (lut_dist(dx + x2, dy + y2) * 4) / 12 +
-                  lut_sin (lut_dist(dx + x3, dy + y3) * 6) / 12 +
-                  lut_sin (lut_dist(dx + x4, dy + y4) * 8) / 12;
-          break;
-
-        case 25:
-          color = angle + lut_sin (lut_dist(dx + x1, dy + y1) * 2) / 16 +
-                  angle + lut_sin (lut_dist(dx + x2, dy + y2) * 4) / 16 +
-                  lut_sin (lut_dist(dx + x3, dy + y3) * 6) /  8 +
-                  lut_sin (lut_dist(dx + x4, dy + y4) * 8) /  8;
-          break;
-
-        case 26:
-          color = angle + lut_sin (lut_dist(dx + x1, dy + y1) * 2) / 12 +
-                  angle + lut_sin (lut_dist(dx + x2, dy + y2) * 4) / 12 +
-                  angle + lut_sin (lut_dist(dx + x3, dy + y3) * 6) / 12 +
-                  angle + lut_sin (lut_dist(dx + x4, dy + y4) * 8) / 12;
-          break;
-
-        case 27:
-          color = lut_sin (lut_dist(dx + x1, dy + y1) * 2) / 32 +
-                  lut_sin (lut_dist(dx + x2, dy + y2) * 4) / 32 +
-                  lut_sin (lut_dist(dx + x3, dy + y3) * 6) / 32 +
-                  lut_sin (lut_dist(dx + x4, dy + y4) * 8) / 32;
-          break;
-
-        case 28:        /* Random Curtain of Rain (in strong wind) */
-          if (y == 0 || x == 0)
-            color = RANDOMD(16);
-          else
-            color = (  *(buf_graf + (pitch *  _y   ) + (_x-1))
-                       + *(buf_graf + (pitch * (_y-1)) +    _x)) / 2.0
-                    + RANDOMD(16) - 8;
-          break;
-
-        case 29:
-          if (y == 0 || x == 0)
-            color = RANDOMD(1024);
-          else
-            color = dist/6 + (*(buf_graf + (pitch * _y    ) + (_x-1))
-                              +  *(buf_graf + (pitch * (_y-1)) +    _x)) / 2.0
-                    + RANDOMD(16) - 8;
-          break;
-
-        case 30:
-          color = (((int)lut_sin (lut_dist(dx,     dy - 20) * 4) / 32 ^
-                    (int)lut_sin (lut_dist(dx + 20,dy + 20) * 4) / 32) ^
-                   (int)lut_sin (lut_dist(dx - 20,dy + 20) * 4) / 32);
-          break;
-
-        case 31:
-          color = ((int)fmod(angle, (ANGLE_UNIT/4)) ^ (int)dist);
-          break;
-
-        case 32:        /* Plaid (Useful for aspect ratio verification) */
-          color = ((int)dy ^ (int)dx);
-          break;
-
-        case 33:        /* Variation on Rain */
-          if (y == 0 || x == 0)
-            color = RANDOMD(16);
-          else
-            color = (  *(buf_graf + (pitch *  _y   ) + (_x-1))
-                       + *(buf_graf + (pitch * (_y-1)) +  _x   )  ) / 2.0;
-
-          color += RANDOMD(2) - 1;
-
-          if (color < 64)
-            color += RANDOMD(16) - 8;
-          break;
-
-        case 34:        /* Variation on Rain */
-          if (y == 0 || x == 0)
-            color = RANDOMD(16);
-          else
-            color = (  *(buf_graf + (pitch *  _y   ) + (_x-1))
-                       + *(buf_graf + (pitch * (_y-1)) +  _x   )  ) / 2.0;
-
-          if (color < 100)
-            color += RANDOMD(16) - 8;
-          break;
-
-        case 35:
-          color = angle + lut_sin(dist * 8)/32;
-          dx = x - x_center;
-          dy = (y - y_center) * 2;
-          dist  = lut_dist (dx, dy);
-          angle = lut_angle (dx, dy);
-          color = (color + angle + lut_sin(dist * 8)/32) / 2;
-          break;
-
-        case 36:
-          color = angle + lut_sin (dist * 10) / 16 +
-                  lut_cos (x * ANGLE_UNIT / width * 2) / 8 +
-                  lut_cos (y * ANGLE_UNIT / height * 2) / 8;
-          dx = x - x_center;
-          dy = (y - y_center) * 2;
-          dist  = lut_dist (dx, dy);
-          angle = lut_angle (dx, dy);
-          color = (color + angle + lut_sin(dist * 8)/32) / 2;
-          break;
-
-        case 37:
-          color = angle + lut_sin (dist * 10) / 16 +
-                  lut_cos (x * ANGLE_UNIT / width * 2) / 8 +
-                  lut_cos (y * ANGLE_UNIT / height * 2) / 8;
-          dx = x - x_center;
-          dy = (y - y_center) * 2;
-          dist  = lut_dist (dx, dy);
-          angle = lut_angle (dx, dy);
-          color = (color + angle + lut_sin (dist * 10) / 16 +
-                   lut_cos (x * ANGLE_UNIT / width * 2) / 8 +
-                   lut_cos (y * ANGLE_UNIT / height * 2) / 8)  /  2;
-          break;
-
-        case 38:
-          /* Intent is to interlace two different screens */
-          if (_y % 2)
-          {
-            dy *= 2;
-            dist  = lut_dist (dx, dy);
-            angle = lut_angle (dx, dy);
-          }
-          color = angle + lut_sin(dist * 8)/32;
-          break;
-
-        case 39:
-          color = ((int)fmod(angle, (ANGLE_UNIT/4)) ^ (int)dist);
-          dx = x - x_center;
-          dy = (y - y_center) * 2;
-          dist = lut_dist (dx, dy);
-          angle = lut_angle (dx, dy);
-          color = (color +  (((int)fmod(angle, (ANGLE_UNIT/4)) ^ (int)dist))) / 2;
-          break;
-
-        case 40:
-          color = ((int)dy ^ (int)dx);
-          dx = x - x_center;
-          dy = (y - y_center) * 2;
-          color = (color +  ((int)dy ^ (int)dx)) / 2;
-          break;
-
-        case 41:        /* 12-fold Mandala Symmetry #claude */
-          {
-            double sym_angle = fmod(angle * 6, ANGLE_UNIT/2);
-            if (sym_angle > ANGLE_UNIT/4) sym_angle = ANGLE_UNIT/2 - sym_angle;
-            color = sym_angle * 4 + lut_sin(dist * 8) / 32 +
-                    lut_cos(dist * 3) / 64;
+      break;
+    }
+
+    /* The bend is checked at both ends of the block where there are
+     * lattice rows on both sides. A band of a single block is evaluated.
+     */
+    for (bx = 0; bx < blocks; ++bx) {
+      const gen_t above = k > 0 ? bend[k * blocks + bx] : 0;
+      const gen_t below = k + 2 < lattice ? bend[(k + 1) * blocks + bx] : 0;
+      smooth[bx] = lattice > 2 && MAX(above, below) <= GEN_ADAPTIVE_BEND;
+    }
+
+    for (_y = b0 + 1; _y < b1; ++_y) {
+      const gen_t t = (gen_t)(_y - b0) / block;
+
+      if (mirror_copied(a, _y)) continue;
+      for (bx = 0; bx < blocks; bx = bx_end) {
+        /* Runs of blocks which are evaluated are evaluated together */
+        for (bx_end = bx + 1;
+             bx_end < blocks && smooth[bx_end] == smooth[bx]; ++bx_end);
+        x0 = bx * block;
+        x1 = MIN(bx_end * block, n);
+        if (smooth[bx]) {
+          for (_x = x0; _x < x1; ++_x) {
+            color[_x] = top[_x] + (bottom[_x] - top[_x]) * t;
           }
-          break;
+        } else {
+          evaluated += color_samples(func, &r, _y, x0, x1, color, dist, angle);
+        }
+      }
+      mirror_colors(a, color);
+      store_colors(a, color, _y);
+      drawn += drawn_cols;
+    }
+  }
+
+  SDL_AddAtomicInt(&a->counts[0], evaluated);
+  SDL_AddAtomicInt(&a->counts[1], drawn);
+  free(scratch);
+}
+
+static void generate_band(void *arg, int band)
+{
+  const struct gen_args *a = arg;
+  int row_begin = band * a->band_rows;
+  int row_end = MIN(row_begin + (int)a->band_rows, (int)a->rows);
+
+  if (a->adaptive > 0) {
+    generate_adaptive_rows(a, row_begin, row_end);
+  } else {
+    generate_rows(a, row_begin, row_end);
+  }
+}
+
+/* Where band keeps its last row in a->edges. Sliced images draw bands in
+ * order, so they only keep the last two.
+ */
+static size_t edge_slot(const struct gen_args *a, int band)
+{
+  return (UINT)band % a->edge_bands;
+}
+
+/* Waits until the band above has finished its last row up to sample x1.
+ * Returns 0 if drawing was aborted instead.
+ */
+static int wait_edge(const struct gen_args *a, int band, UINT x1)
+{
+  int spins = 0;
+
+  while ((UINT)SDL_GetAtomicInt(&a->edge_done[edge_slot(a, band - 1)]) < x1) {
+    if (abort_draw) return 0;
+    if (++spins < 1000) {
+      SDL_CPUPauseInstruction();
+    } else {
+      /* The band above may be waiting for a CPU */
+      SDL_Delay(0);
+    }
+  }
+  return 1;
+}
+
+static void generate_wave_rows(const struct gen_args *a, int band)
+{
+  const struct gen_func *func = get_func(a->imageFuncNum);
+  const UINT n = a->cols;
+  const int row_begin = band * a->band_rows;
+  const int rows = MIN(row_begin + (int)a->band_rows, (int)a->rows) - row_begin;
+  gen_t * const edge = a->edges + edge_slot(a, band) * n;
+  struct rng rng[GEN_BAND_ROWS];
+  struct gen_row r;
+  gen_t *scratch, *lines, *x, *dx, *dist, *angle;
+  UCHAR *out, *samples;
+  UINT x0, x1, _x;
+  int i;
+
+  /* Palette indices of every row but the last, which goes to the edge
+   * row read by the band below.
+   */
+  scratch = malloc((GEN_BAND_ROWS + 5) * (size_t)n * sizeof(gen_t));
+  if (scratch == NULL) return;
+  lines = scratch;
+  x     = lines + GEN_BAND_ROWS * (size_t)n;
+  dx    = x + n;
+  dist  = dx + n;
+  angle = dist + n;
+  samples = (UCHAR *)(angle + n);
+
+  r.a = a;
+  r.n = n;
+  r.x0 = 0;
+  set_columns(a, &r, x, dx);
+  for (i = 0; i < rows; ++i) {
+    row_seed(&rng[i], a->seed, (row_begin + i) * a->step);
+  }
+
+  for (x0 = 0; x0 < n && !abort_draw; x0 = x1) {
+    x1 = MIN(x0 + GEN_BLOCK_COLS, n);
+    if (band > 0 && !wait_edge(a, band, x1)) break;
 
-        default:
-          color = RANDOMD(colors - 1) + 1;
-          break;
+    for (i = 0; i < rows; ++i) {
+      set_row(a, &r, (row_begin + i) * a->step, dist, angle, x0, x1);
+      r.line = i == rows - 1 ? edge : lines + i * (size_t)n;
+      if (i > 0) {
+        r.above = lines + (i - 1) * (size_t)n;
+      } else {
+        r.above = band > 0 ? a->edges + edge_slot(a, band - 1) * n : NULL;
+      }
+      r.rng = rng[i];
+      func->neighbour(&r, x0, x1);
+      rng[i] = r.rng;
+
+      if (a->step == 1) {
+        out = a->buf_graf + (size_t)a->pitch * r._y;
+        for (_x = x0; _x < x1; ++_x) out[_x] = (UCHAR)r.line[_x];
+        /* These colors are whole palette indices */
+        if (a->frac_graf != NULL) {
+          memset(a->frac_graf + (size_t)a->pitch * r._y + x0, 0, x1 - x0);
+        }
+      }
+    }
+    SDL_SetAtomicInt(&a->edge_done[edge_slot(a, band)], (int)x1);
+  }
+
+  if (a->step > 1 && !abort_draw) {
+    /* Whole rows are needed to fill blocks */
+    for (i = 0; i < rows; ++i) {
+      const gen_t *line = i == rows - 1 ? edge : lines + i * (size_t)n;
+      for (_x = 0; _x < n; ++_x) samples[_x] = (UCHAR)line[_x];
+      expand_row(a, a->buf_graf, samples, (row_begin + i) * a->step);
+      if (a->frac_graf != NULL) {
+        memset(samples, 0, n);
+        expand_row(a, a->frac_graf, samples, (row_begin + i) * a->step);
+      }
+    }
+  }
+
+  free(scratch);
+}
+
+static void generate_wave_band(void *arg, int band)
+{
+  const struct gen_args *a = arg;
+
+  generate_wave_rows(a, band);
+  /* Even if this band failed, the band below must not wait forever */
+  SDL_SetAtomicInt(&a->edge_done[edge_slot(a, band)], INT_MAX);
+}
+
+/* What an image of this engine sets up before drawing its rows, in order */
+enum {
+  PHASE_FIELD,                  /* the polar field */
+  PHASE_WAVES,                  /* column_waves() */
+  PHASE_PROFILE,                /* the profile table, see profile_begin() */
+  PHASE_WIDE,                   /* the wide distance field, see use_wide() */
+  PHASE_COLUMNS,                /* formula_columns() */
+  PHASE_ROWS
+};
+
+/* An image of this engine being drawn, see generate_job_float() */
+struct gen_state {
+  struct gen_args a;
+  struct gen_job job;
+  int sliced;                   /* drawn a step at a time by generate_job_run() */
+  int phase;
+  int widening;                 /* the wide field is being built a row at a time */
+  gen_pool_job band;
+  int bands, next;              /* bands of a->band_rows, and the next one drawn */
+  struct polar_field coarse;    /* coarse previews: parameters only */
+  SDL_AtomicInt counts[2];
+  gen_t *waves;                 /* owned buffers which a points to */
+  struct gen_profile profile;
+  double *expr_columns;
+};
+
+/* Finishes the image once all bands are drawn, and frees the job */
+static void end_job(void *arg, int done)
+{
+  struct gen_state *st = arg;
+  const struct gen_args *a = &st->a;
+  UINT _y;
+
+  if (done) {
+    gen_evaluated = 1.0;
+    if (a->adaptive > 0 && SDL_GetAtomicInt(&st->counts[1]) > 0) {
+      gen_evaluated = (double)SDL_GetAtomicInt(&st->counts[0]) /
+                      SDL_GetAtomicInt(&st->counts[1]);
+    }
+  }
+
+  if (done && (a->mirror & GEN_MIRROR_Y)) {
+    for (_y = mirror_begin(a->_ycenter, a->_height); _y < a->_ycenter; ++_y) {
+      memcpy(a->buf_graf + (size_t)a->pitch * _y,
+             a->buf_graf + (size_t)a->pitch * (2 * a->_ycenter - _y),
+             a->_width);
+      if (a->frac_graf != NULL) {
+        memcpy(a->frac_graf + (size_t)a->pitch * _y,
+               a->frac_graf + (size_t)a->pitch * (2 * a->_ycenter - _y),
+               a->_width);
       }
+    }
+  }
+
+  free(st->waves);
+  free(st->profile.table);
+  free(st->profile.samples);
+  free(st->profile.index);
+  free(st->expr_columns);
+  free(st->a.edges);
+  free(st->a.edge_done);
+  free(st);
+}
+
+/* Sets up an image with everything which is quick to do. The rest is done
+ * by setup_step(). Returns NULL if out of memory.
+ */
+static struct gen_state *new_state(int imageFuncNum,
+                                   UCHAR *buf_graf,
+                                   UINT _xcenter,
+                                   UINT _ycenter,
+                                   UINT _width,
+                                   UINT _height,
+                                   UINT colors,
+                                   UINT pitch,
+                                   UINT normalize,
+                                   UINT step,
+                                   int sliced)
+{
+  const struct gen_func *func = get_func(imageFuncNum);
+  struct gen_state *st;
+  struct gen_args *a;
+  struct gen_warp params;
+  UINT band;
+
+  st = calloc(1, sizeof(*st));
+  if (st == NULL) return NULL;
+  st->sliced = sliced;
+  a = &st->a;
 
-      /* Fit color value into the palette range using modulo.  It seems
-         that the Turbo-C MOD function does not behave the way I expect.
-         It gives negative values for the MOD of a negative number.
-         I expect MOD to function as it does on my HP-28S.
-       */
-
-
-      /* Final colors need to go from 1 to colors, because color 0 is
-       * not used. Floating point conversion to the palette is by
-       * truncation, not rounding, as if each whole number is a bin
-       * (0 for 0 to 1, 1 for 1 to 2 and so on). 1 is added later,
-       * so right here this requires: 0 <= color < colors
-       */
-      _color = (long)color % (colors-1);
-      /* The -1.0 < color < 0 bin is mapped to the last bin,
-       * meaning right before the 0 <= color < 1 bin in rotation.
-       */
-      if (color < 0)
-        _color += (colors - 2);
-
-      ++_color;
-      /* color 0 is never used, so all colors are from 1 through 255 */
-
-      *(buf_graf + (pitch * _y) + _x) = (UCHAR)_color;
-      /* Store the color in the buffer */
+  a->imageFuncNum = imageFuncNum;
+  a->buf_graf = buf_graf;
+  a->frac_graf = gen_fraction;
+  a->_width = _width;
+  a->_height = _height;
+  a->colors = colors;
+  a->pitch = pitch;
+  a->normalize = normalize;
+  a->step = step > 1 ? step : 1;
+  a->rows = (_height + a->step - 1) / a->step;
+  a->cols = (_width + a->step - 1) / a->step;
+  a->_xcenter = _xcenter;
+  a->_ycenter = _ycenter;
+  if (a->step > 1) {
+    /* Coordinates are only needed for a few pixels, so building the
+     * cached field for every pixel would cost more than the whole image.
+     */
+    polar_field_params(&st->coarse, _width, _height, _xcenter, _ycenter,
+                       normalize);
+    a->pf = &st->coarse;
+  } else if (sliced) {
+    /* Built by setup_step() */
+    a->pf = polar_field_begin(_width, _height, _xcenter, _ycenter, normalize,
+                              sizeof(gen_t) == sizeof(float));
+  } else {
+    a->pf = polar_field_get(_width, _height, _xcenter, _ycenter, normalize);
+  }
+
+  generate_params(&params);
+  a->x1 = (gen_t)params.offsets[0];  a->x2 = (gen_t)params.offsets[1];
+  a->x3 = (gen_t)params.offsets[2];  a->x4 = (gen_t)params.offsets[3];
+  a->y1 = (gen_t)params.offsets[4];  a->y2 = (gen_t)params.offsets[5];
+  a->y3 = (gen_t)params.offsets[6];  a->y4 = (gen_t)params.offsets[7];
+  a->seed = params.seed;
+
+  /* Symmetric functions only draw one side of each mirror axis. Samples
+   * of coarse previews are not placed symmetrically about the centre.
+   */
+  if (a->step == 1 && _xcenter < _width && _ycenter < _height) {
+    a->mirror = func->flags & GEN_MIRROR_XY;
+    /* A panned view is no longer symmetric about the centre */
+    if (a->pf->pan_x != 0.0) a->mirror &= ~GEN_MIRROR_X;
+    if (a->pf->pan_y != 0.0) a->mirror &= ~GEN_MIRROR_Y;
+  }
+
+  a->tmp_rows = GEN_TMP_ROWS;
+#ifndef GEN_FLOAT32
+  if (func->color == func_expr) {
+    a->expr = expr_get(imageFuncNum - FIRST_FORMULA_FUNCTION);
+    a->tmp_rows = MAX(GEN_TMP_ROWS, (UINT)expr_scratch_rows(a->expr));
+  }
+#endif
+
+  /* Coarse previews already evaluate few pixels. Sliced images are drawn a
+   * row at a time, but adaptive blocks span several rows.
+   */
+  if (gen_adaptive > 1 && a->step == 1 && !sliced &&
+      ((func->flags & GEN_ADAPTIVE) ||
+       (gen_adaptive_all && func->neighbour == NULL))) {
+    a->adaptive = gen_adaptive;
+  }
+  SDL_SetAtomicInt(&st->counts[0], 0);
+  SDL_SetAtomicInt(&st->counts[1], 0);
+  a->counts = st->counts;
+
+  /* Adaptive bands share their first and last lattice rows, so they are
+   * taller to evaluate fewer of those twice
+   */
+  if (sliced) {
+    a->band_rows = 1;
+  } else {
+    a->band_rows = a->adaptive > 0 ? a->adaptive * GEN_ADAPTIVE_BLOCKS
+                                   : GEN_BAND_ROWS;
+  }
+  st->bands = (a->rows + a->band_rows - 1) / a->band_rows;
+  st->band = generate_band;
+  if (func->neighbour != NULL) {
+    a->edge_bands = sliced ? MIN(2, st->bands) : st->bands;
+    a->edges = malloc((size_t)a->edge_bands * a->cols * sizeof(gen_t));
+    a->edge_done = malloc(a->edge_bands * sizeof(SDL_AtomicInt));
+    if (a->edges == NULL || a->edge_done == NULL) {
+      end_job(st, 0);
+      return NULL;
+    }
+    for (band = 0; band < a->edge_bands; ++band) {
+      SDL_SetAtomicInt(&a->edge_done[band], 0);
     }
-    /* end for (y = 0; y < height; ++y)        */
+    st->band = generate_wave_band;
+  }
+  return st;
+}
+
+/* Builds the next row of the wide distance field if it is used, or all of
+ * it unless sliced. Returns 1 once it is done.
+ */
+static int wide_step(struct gen_state *st)
+{
+  struct gen_args *a = &st->a;
+  const int single = sizeof(gen_t) == sizeof(float);
+  UINT margin_x, margin_y;
+
+  if (!st->widening) {
+    if (!(get_func(a->imageFuncNum)->flags & (GEN_CENTRES | GEN_OFFSET_CENTRES)) ||
+        !use_wide(a, &margin_x, &margin_y)) {
+      return 1;
+    }
+    if (!st->sliced) {
+      if (polar_field_widen(margin_x, margin_y, single)) {
+        a->dist_wide = a->pf->FIELD(dist_wide);
+      }
+      return 1;
+    }
+    /* Without it, distances are computed */
+    if (!polar_field_widen_begin(margin_x, margin_y, single)) return 1;
+    st->widening = 1;
+  }
+  if (!polar_field_widen_row(single)) return 0;
+  a->dist_wide = a->pf->FIELD(dist_wide);
+  return 1;
+}
+
+/* Builds the next chunk of the profile table if it is used, or all of it
+ * unless sliced. Returns 1 once it is done, or -1 if out of memory.
+ */
+static int profile_step(struct gen_state *st)
+{
+  struct gen_args *a = &st->a;
+
+  /* A coarse preview has too few pixels to be worth a profile table */
+  if (!(get_func(a->imageFuncNum)->flags & GEN_PROFILE) || a->step > 1) {
+    return 1;
+  }
+  if (st->profile.table == NULL && !profile_begin(a, &st->profile)) {
+    return -1;
+  }
+  while (!profile_chunk(a, &st->profile)) {
+    if (st->sliced) return 0;
+  }
+  a->profile = st->profile.table;
+  a->profile_index = st->profile.index;
+  a->profile_len = st->profile.len;
+  return 1;
+}
+
+/* Takes the next step of setting up the image, which is about a row of the
+ * polar field or of a table if sliced, and otherwise a whole phase.
+ * Returns 0 if out of memory.
+ */
+static int setup_step(struct gen_state *st)
+{
+  struct gen_args *a = &st->a;
+  const struct gen_func *func = get_func(a->imageFuncNum);
+  int done = 1;
+
+  switch (st->phase) {
+    case PHASE_FIELD:
+      /* Only sliced images get a field which is not built yet */
+      if (st->sliced && a->step == 1) {
+        done = polar_field_build_row(sizeof(gen_t) == sizeof(float));
+      }
+      break;
+
+    case PHASE_WAVES:
+      if (func->flags & GEN_WAVES) {
+        a->waves = st->waves = column_waves(a, a->cols);
+        if (st->waves == NULL) done = -1;
+      }
+      break;
+
+    case PHASE_PROFILE:
+      done = profile_step(st);
+      break;
+
+    case PHASE_WIDE:
+      done = wide_step(st);
+      break;
+
+#ifndef GEN_FLOAT32
+    case PHASE_COLUMNS:
+      if (a->expr != NULL) {
+        a->expr_columns = st->expr_columns = formula_columns(a);
+        if (st->expr_columns == NULL) done = -1;
+      }
+      break;
+#endif
+  }
+
+  if (done > 0) ++st->phase;
+  return done >= 0;
+}
+
+/* Takes the next step of a sliced image, see struct gen_job. Bands of
+ * neighbour functions wait for the band above, which is always done when
+ * they are drawn in order.
+ */
+static int job_step(void *arg)
+{
+  struct gen_state *st = arg;
+
+  if (st->phase < PHASE_ROWS) {
+    return setup_step(st) ? 0 : -1;
+  }
+  st->band(&st->a, st->next++);
+  return st->next >= st->bands;
+}
+
+struct gen_job *GEN_JOB(int imageFuncNum,
+                        UCHAR *buf_graf,
+                        UINT _xcenter,
+                        UINT _ycenter,
+                        UINT _width,
+                        UINT _height,
+                        UINT colors,
+                        UINT pitch,
+                        UINT normalize,
+                        UINT step)
+{
+  struct gen_state *st = new_state(imageFuncNum, buf_graf, _xcenter, _ycenter,
+                                   _width, _height, colors, pitch, normalize,
+                                   step, 1);
+
+  if (st == NULL) return NULL;
+  st->job.step = job_step;
+  st->job.arg = st;
+  st->job.end = end_job;
+  return &st->job;
+}
+
+void GEN_ENGINE(int imageFuncNum,
+                UCHAR *buf_graf,
+                UINT _xcenter,
+                UINT _ycenter,
+                UINT _width,
+                UINT _height,
+                UINT colors,
+                UINT pitch,
+                UINT normalize,
+                UINT step)
+{
+  struct gen_state *st = new_state(imageFuncNum, buf_graf, _xcenter, _ycenter,
+                                   _width, _height, colors, pitch, normalize,
+                                   step, 0);
+  int ok = 1;
+
+  if (st == NULL) return;
+  while (ok && st->phase < PHASE_ROWS) {
+    ok = setup_step(st);
+  }
+  if (ok) {
+    gen_pool_run(st->band, &st->a, st->bands);
+  }
+  end_job(st, ok && !abort_draw);
+}
+
+#ifndef GEN_FLOAT32
+static const struct gen_warp *warp = NULL;
+UCHAR *gen_fraction = NULL;
+
+void generate_set_fraction(UCHAR *frac)
+{
+  gen_fraction = frac;
+}
+
+UINT gen_adaptive = 0;
+int gen_adaptive_all = 0;
+double gen_evaluated = 1.0;
+
+void generate_set_adaptive(UINT block, int all)
+{
+  gen_adaptive = block;
+  gen_adaptive_all = all;
+}
+
+double generate_evaluated(void)
+{
+  return gen_evaluated;
+}
+
+void generate_set_warp(const struct gen_warp *w)
+{
+  warp = w;
+}
+
+void generate_set_view(const struct gen_view *view)
+{
+  if (view != NULL) {
+    polar_set_view(view->zoom, view->x, view->y);
+  } else {
+    polar_set_view(1.0, 0.0, 0.0);
+  }
+}
+
+void generate_params(struct gen_warp *params)
+{
+  int i;
+
+  if (warp != NULL) {
+    *params = *warp;
+    return;
+  }
+
+  /* Some general purpose random angles and offsets.
+   * Not all functions use them.
+   */
+  for (i = 0; i < 8; ++i) {
+    params->offsets[i] = (int)rng_below(&rng_draw, 40)-20;
+  }
+  params->seed = rng_next(&rng_draw);
+}
+
+/* Relative cost of every image function in gen_funcs. This is about the
+ * nanoseconds per pixel generate_image_float() takes on one core of a recent
+ * x86 CPU, averaged over both DRAW_SCALED modes, as measured by
+ * acidwarp-bench. acidwarp-bench -c checks these against measured times.
+ */
+static const UCHAR gen_costs[NUM_GEN_FUNCS] = {
+  10, 10, 20, 11,  1,  7,  7, 13,  7,  4,   /*  0 -  9 */
+   4,  4,  1,  3,  7,  1,  1,  7,  6,  6,   /* 10 - 19 */
+   5,  4,  4,  3, 21, 19, 22, 22, 24, 25,   /* 20 - 29 */
+   5,  4,  2, 24, 23, 14, 14, 14,  9,  9,   /* 30 - 39 */
+   3,  7                                    /* 40 - 41 */
+};
+#define GEN_RANDOM_COST 3
+
+void generate_image_info(int imageFuncNum, struct gen_info *info)
+{
+  const struct gen_func *func = get_func(imageFuncNum);
+
+  info->flags = 0;
+  if (func->flags & GEN_MIRROR_X) info->flags |= GEN_INFO_MIRROR_X;
+  if (func->flags & GEN_MIRROR_Y) info->flags |= GEN_INFO_MIRROR_Y;
+  if (func->flags & GEN_RANDOM) info->flags |= GEN_INFO_RANDOM;
+  if (func->neighbour != NULL) info->flags |= GEN_INFO_NEIGHBOUR;
+  if (!(func->flags & GEN_DOUBLE)) info->flags |= GEN_INFO_SINGLE;
+  if (func->flags & GEN_ADAPTIVE) info->flags |= GEN_INFO_ADAPTIVE;
+
+  if (func->color == func_expr) {
+    info->flags |= GEN_INFO_FORMULA;
+    info->cost = expr_cost(expr_get(imageFuncNum - FIRST_FORMULA_FUNCTION));
+  } else if (func == &random_func) {
+    info->flags |= GEN_INFO_UNKNOWN;
+    info->cost = GEN_RANDOM_COST;
+  } else {
+    info->cost = gen_costs[imageFuncNum];
+  }
+}
+
+int generate_image_single(int imageFuncNum)
+{
+  return (get_func(imageFuncNum)->flags & GEN_DOUBLE) ? 0 : 1;
+}
+
+void generate_image_float(int imageFuncNum,
+                          UCHAR *buf_graf,
+                          UINT _xcenter,
+                          UINT _ycenter,
+                          UINT _width,
+                          UINT _height,
+                          UINT colors,
+                          UINT pitch,
+                          UINT normalize,
+                          UINT step)
+{
+  if (generate_image_single(imageFuncNum)) {
+    generate_image_float32(imageFuncNum, buf_graf, _xcenter, _ycenter,
+                           _width, _height, colors, pitch, normalize, step);
+  } else {
+    generate_image_double(imageFuncNum, buf_graf, _xcenter, _ycenter,
+                          _width, _height, colors, pitch, normalize, step);
+  }
+}
+
+struct gen_job *generate_job_float(int imageFuncNum,
+                                   UCHAR *buf_graf,
+                                   UINT _xcenter,
+                                   UINT _ycenter,
+                                   UINT _width,
+                                   UINT _height,
+                                   UINT colors,
+                                   UINT pitch,
+                                   UINT normalize,
+                                   UINT step)
+{
+  if (generate_image_single(imageFuncNum)) {
+    return generate_job_float32(imageFuncNum, buf_graf, _xcenter, _ycenter,
+                                _width, _height, colors, pitch, normalize,
+                                step);
+  }
+  return generate_job_double(imageFuncNum, buf_graf, _xcenter, _ycenter,
+                             _width, _height, colors, pitch, normalize, step);
+}
+
+int generate_job_run(struct gen_job *job, double ms)
+{
+  const Uint64 end = SDL_GetTicksNS() + (Uint64)(ms * 1000000.0);
+
+  while (job->status == 0 && !abort_draw) {
+    job->status = job->step(job->arg);
+    if (SDL_GetTicksNS() >= end) break;
   }
-  /* end for (x = 0; x < width; ++x)        */
+  return job->status != 0 || abort_draw;
+}
 
+void generate_job_free(struct gen_job *job)
+{
+  job->end(job->arg, job->status > 0 && !abort_draw);
 }
+#endif
@@ -0,0 +1,4 @@
+/* Single precision image generation engine for Acid Warp */
+
+#define GEN_FLOAT32
+#include "gen_img.c"
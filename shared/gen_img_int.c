@@ -0,0 +1,565 @@
+#pragma ide diagnostic ignored "cert-msc50-cpp"
+#include <stdlib.h>
+#include <string.h>
+#include "handy.h"
+#include "acidwarp.h"
+#include "img_int.h"
+#include "gen_pool.h"
+#include "rng.h"
+
+/* ACID WARP (c)Copyright 1992, 1993 by Noah Spurrier
+ * All Rights reserved. Private Proprietary Source Code by Noah Spurrier
+ * Ported to Linux by Steven Wills
+ * Ported to SDL by Boris Gjenero
+ * Ported to Android, iOS / iPadOS, macOS, Linux, Windows by Matthew Zavislak
+ */
+
+/* Fixed point image generator. It evaluates the same image functions as
+ * generate_image_float(), using the fixed point lut functions in img_int.c,
+ * for CPUs where double precision math is slow. All values below are fixed
+ * point with FIX_BITS fractional bits.
+ */
+
+#define GEN_BAND_ROWS 16
+
+struct gen_int_args {
+  int imageFuncNum;
+  UCHAR *buf_graf;
+  UINT _width, _height;
+  UINT colors, pitch;
+  UINT step, rows;  /* pixels per sample, and rows of samples */
+  long x_center, y_center;
+  long *dx;   /* per column, x - x_center */
+  long *xa;   /* per column, x * ANGLE_UNIT / width */
+  long *y;    /* per row */
+  long *ya;   /* per row, y * ANGLE_UNIT / height */
+  long x1,x2,x3,x4,y1,y2,y3,y4;
+  UINT seed;
+};
+
+/* Same per row random numbers as generate_image_float() */
+static void row_seed(struct rng *r, UINT seed, int y)
+{
+  rng_seed(r, seed ^ ((UINT)y * 0x85EBCA6Bu));
+}
+
+/* Same palette fitting as generate_image_float(), see there */
+static inline UCHAR quantize(long color, UINT colors)
+{
+  ULONG _color;
+
+  _color = color / FIX_ONE % (long)(colors-1);
+  if (color < 0)
+    _color += (colors - 2);
+
+  ++_color;
+  return (UCHAR)_color;
+}
+
+static void generate_rows(const struct gen_int_args *a, int row_begin, int row_end)
+{
+  const int imageFuncNum = a->imageFuncNum;
+  UCHAR * const buf_graf = a->buf_graf;
+  const UINT _width = a->_width;
+  const UINT colors = a->colors, pitch = a->pitch, step = a->step;
+  const long x1 = a->x1, x2 = a->x2, x3 = a->x3, x4 = a->x4;
+  const long y1 = a->y1, y2 = a->y2, y3 = a->y3, y4 = a->y4;
+
+  int row, _y;
+  UINT _x, i;
+  long dx, dy, ya;
+  long dist, angle;
+  long color;
+
+  for (row = row_begin; row < row_end && !abort_draw; ++row)
+  {
+    struct rng rng;
+    UCHAR *out;
+    const UCHAR *prev;
+
+    _y = row * step;
+    out = buf_graf + (size_t)pitch * _y;
+    prev = _y > 0 ? out - pitch : NULL;
+
+    row_seed(&rng, a->seed, _y);
+    ya = a->ya[_y];
+
+    for (_x = 0; _x < _width; _x += step)
+    {
+      const long xa = a->xa[_x];
+
+      dx = a->dx[_x];
+      /* dy may be altered below, so calculate here */
+      dy = a->y[_y] - a->y_center;
+      dist  = fix_dist (dx, dy);
+      angle = fix_angle (dx, dy);
+
+      switch (imageFuncNum)
+      {
+        case 0: /* Rays plus 2D Waves */
+          color = angle + fix_sin (dist * 10) / 64 +
+                  fix_cos (xa * 2) / 32 +
+                  fix_cos (ya * 2) / 32;
+          break;
+
+        case 1:        /* Rays plus 2D Waves */
+          color = angle + fix_sin (dist * 10) / 16 +
+                  fix_cos (xa * 2) / 8 +
+                  fix_cos (ya * 2) / 8;
+          break;
+
+        case 2:
+          color = fix_sin (fix_dist(dx + x1, dy + y1) *  4) / 32 +
+                  fix_sin (fix_dist(dx + x2, dy + y2) *  8) / 32 +
+                  fix_sin (fix_dist(dx + x3, dy + y3) * 16) / 32 +
+                  fix_sin (fix_dist(dx + x4, dy + y4) * 32) / 32;
+          break;
+
+        case 3:        /* Peacock */
+          color = angle + fix_sin (fix_dist(dx + FIX(20), dy) * 10) / 32 +
+                  angle + fix_sin (fix_dist(dx - FIX(20), dy) * 10) / 32;
+          break;
+
+        case 4:
+          color = fix_sin (dist) / 16;
+          break;
+
+        case 5:        /* 2D Wave + Spiral */
+          color = fix_cos (xa) / 8 +
+                  fix_cos (ya) / 8 +
+                  angle + fix_sin(dist) / 32;
+          break;
+
+        case 6:        /* Peacock, three centers */
+          color = fix_sin (fix_dist(dx,           dy - FIX(20)) * 4) / 32+
+                  fix_sin (fix_dist(dx + FIX(20), dy + FIX(20)) * 4) / 32+
+                  fix_sin (fix_dist(dx - FIX(20), dy + FIX(20)) * 4) / 32;
+          break;
+
+        case 7:        /* Peacock, three centers */
+          color = angle +
+                  fix_sin (fix_dist(dx,           dy - FIX(20)) * 8) / 32+
+                  fix_sin (fix_dist(dx + FIX(20), dy + FIX(20)) * 8) / 32+
+                  fix_sin (fix_dist(dx - FIX(20), dy + FIX(20)) * 8) / 32;
+          break;
+
+        case 8:        /* Peacock, three centers */
+          color = fix_sin (fix_dist(dx,           dy - FIX(20)) * 12) / 32+
+                  fix_sin (fix_dist(dx + FIX(20), dy + FIX(20)) * 12) / 32+
+                  fix_sin (fix_dist(dx - FIX(20), dy + FIX(20)) * 12) / 32;
+          break;
+
+        case 9:        /* Five Arm Star */
+          color = dist + fix_sin (5 * angle) / 64;
+          break;
+
+        case 10:        /* 2D Wave */
+          color = fix_cos (xa * 2) / 4 +
+                  fix_cos (ya * 2) / 4;
+          break;
+
+        case 11:        /* 2D Wave */
+          color = fix_cos (xa) / 8 +
+                  fix_cos (ya) / 8;
+          break;
+
+        case 12:        /* Simple Concentric Rings */
+          color = dist;
+          break;
+
+        case 13:        /* Simple Rays */
+          color = angle;
+          break;
+
+        case 14:        /* Toothed Spiral Sharp */
+          color = angle + fix_sin(dist * 8)/32;
+          break;
+
+        case 15:        /* Rings with sine */
+          color = fix_sin(dist * 4)/32;
+          break;
+
+        case 16:        /* Rings with sine with sliding inner Rings */
+          color = dist+ fix_sin(dist * 4) / 32;
+          break;
+
+        case 17:
+          color = fix_sin(fix_cos(2 * xa)) * FIX_ONE / (FIX(20) + dist)
+                  + fix_sin(fix_cos(2 * ya)) * FIX_ONE / (FIX(20) + dist);
+          break;
+
+        case 18:        /* 2D Wave */
+          color = fix_cos(7 * xa) * FIX_ONE / (FIX(20) + dist) +
+                  fix_cos(7 * ya) * FIX_ONE / (FIX(20) + dist);
+          break;
+
+        case 19:        /* 2D Wave */
+          color = fix_cos(17 * xa) * FIX_ONE / (FIX(20) + dist) +
+                  fix_cos(17 * ya) * FIX_ONE / (FIX(20) + dist);
+          break;
+
+        case 20:        /* 2D Wave Interference */
+          color = fix_cos(17 * xa) / 32 +
+                  fix_cos(17 * ya) / 32 + dist + angle;
+          break;
+
+        case 21:        /* 2D Wave Interference */
+          color = fix_cos(7 * xa) / 32 +
+                  fix_cos(7 * ya) / 32 + dist;
+          break;
+
+        case 22:        /* 2D Wave Interference */
+          color = fix_cos( 7 * xa) / 32 +
+                  fix_cos( 7 * ya) / 32 +
+                  fix_cos(11 * xa) / 32 +
+                  fix_cos(11 * ya) / 32;
+          break;
+
+        case 23:
+          color = fix_sin (angle * 7) / 32;
+          break;
+
+        case 24:
+          color = fix_sin (fix_dist(dx + x1, dy + y1) * 2) / 12 +
+                  fix_sin (fix_dist(dx + x2, dy + y2) * 4) / 12 +
+                  fix_sin (fix_dist(dx + x3, dy + y3) * 6) / 12 +
+                  fix_sin (fix_dist(dx + x4, dy + y4) * 8) / 12;
+          break;
+
+        case 25:
+          color = angle + fix_sin (fix_dist(dx + x1, dy + y1) * 2) / 16 +
+                  angle + fix_sin (fix_dist(dx + x2, dy + y2) * 4) / 16 +
+                  fix_sin (fix_dist(dx + x3, dy + y3) * 6) /  8 +
+                  fix_sin (fix_dist(dx + x4, dy + y4) * 8) /  8;
+          break;
+
+        case 26:
+          color = angle + fix_sin (fix_dist(dx + x1, dy + y1) * 2) / 12 +
+                  angle + fix_sin (fix_dist(dx + x2, dy + y2) * 4) / 12 +
+                  angle + fix_sin (fix_dist(dx + x3, dy + y3) * 6) / 12 +
+                  angle + fix_sin (fix_dist(dx + x4, dy + y4) * 8) / 12;
+          break;
+
+        case 27:
+          color = fix_sin (fix_dist(dx + x1, dy + y1) * 2) / 32 +
+                  fix_sin (fix_dist(dx + x2, dy + y2) * 4) / 32 +
+                  fix_sin (fix_dist(dx + x3, dy + y3) * 6) / 32 +
+                  fix_sin (fix_dist(dx + x4, dy + y4) * 8) / 32;
+          break;
+
+        case 28:        /* Random Curtain of Rain (in strong wind) */
+          if (_y == 0 || _x == 0)
+            color = (long)rng_below(&rng, FIX(16));
+          else
+            color = FIX(out[_x-1] + prev[_x]) / 2
+                    + (long)rng_below(&rng, FIX(16)) - FIX(8);
+          break;
+
+        case 29:
+          if (_y == 0 || _x == 0)
+            color = (long)rng_below(&rng, FIX(1024));
+          else
+            color = dist/6 + FIX(out[_x-1] + prev[_x]) / 2
+                    + (long)rng_below(&rng, FIX(16)) - FIX(8);
+          break;
+
+        case 30:
+          color = FIX(((int)(fix_sin (fix_dist(dx,           dy - FIX(20)) * 4) / FIX_ONE) / 32 ^
+                       (int)(fix_sin (fix_dist(dx + FIX(20), dy + FIX(20)) * 4) / FIX_ONE) / 32) ^
+                      (int)(fix_sin (fix_dist(dx - FIX(20), dy + FIX(20)) * 4) / FIX_ONE) / 32);
+          break;
+
+        case 31:
+          color = FIX((int)(angle % (FIX_ANGLE_UNIT/4) / FIX_ONE) ^ (int)(dist / FIX_ONE));
+          break;
+
+        case 32:        /* Plaid (Useful for aspect ratio verification) */
+          color = FIX((int)(dy / FIX_ONE) ^ (int)(dx / FIX_ONE));
+          break;
+
+        case 33:        /* Variation on Rain */
+          if (_y == 0 || _x == 0)
+            color = (long)rng_below(&rng, FIX(16));
+          else
+            color = FIX(out[_x-1] + prev[_x]) / 2;
+
+          color += (long)rng_below(&rng, FIX(2)) - FIX(1);
+
+          if (color < FIX(64))
+            color += (long)rng_below(&rng, FIX(16)) - FIX(8);
+          break;
+
+        case 34:        /* Variation on Rain */
+          if (_y == 0 || _x == 0)
+            color = (long)rng_below(&rng, FIX(16));
+          else
+            color = FIX(out[_x-1] + prev[_x]) / 2;
+
+          if (color < FIX(100))
+            color += (long)rng_below(&rng, FIX(16)) - FIX(8);
+          break;
+
+        case 35:
+          color = angle + fix_sin(dist * 8)/32;
+          dy *= 2;
+          dist  = fix_dist (dx, dy);
+          angle = fix_angle (dx, dy);
+          color = (color + angle + fix_sin(dist * 8)/32) / 2;
+          break;
+
+        case 36:
+          color = angle + fix_sin (dist * 10) / 16 +
+                  fix_cos (xa * 2) / 8 +
+                  fix_cos (ya * 2) / 8;
+          dy *= 2;
+          dist  = fix_dist (dx, dy);
+          angle = fix_angle (dx, dy);
+          color = (color + angle + fix_sin(dist * 8)/32) / 2;
+          break;
+
+        case 37:
+          color = angle + fix_sin (dist * 10) / 16 +
+                  fix_cos (xa * 2) / 8 +
+                  fix_cos (ya * 2) / 8;
+          dy *= 2;
+          dist  = fix_dist (dx, dy);
+          angle = fix_angle (dx, dy);
+          color = (color + angle + fix_sin (dist * 10) / 16 +
+                   fix_cos (xa * 2) / 8 +
+                   fix_cos (ya * 2) / 8)  /  2;
+          break;
+
+        case 38:
+          /* Intent is to interlace two different screens */
+          if (_y % 2)
+          {
+            dy *= 2;
+            dist  = fix_dist (dx, dy);
+            angle = fix_angle (dx, dy);
+          }
+          color = angle + fix_sin(dist * 8)/32;
+          break;
+
+        case 39:
+          color = FIX((int)(angle % (FIX_ANGLE_UNIT/4) / FIX_ONE) ^ (int)(dist / FIX_ONE));
+          dy *= 2;
+          dist = fix_dist (dx, dy);
+          angle = fix_angle (dx, dy);
+          color = (color + FIX((int)(angle % (FIX_ANGLE_UNIT/4) / FIX_ONE) ^ (int)(dist / FIX_ONE))) / 2;
+          break;
+
+        case 40:
+          color = FIX((int)(dy / FIX_ONE) ^ (int)(dx / FIX_ONE));
+          dy *= 2;
+          color = (color + FIX((int)(dy / FIX_ONE) ^ (int)(dx / FIX_ONE))) / 2;
+          break;
+
+        case 41:        /* 12-fold Mandala Symmetry #claude */
+          {
+            long sym_angle = angle * 6 % (FIX_ANGLE_UNIT/2);
+            if (sym_angle > FIX_ANGLE_UNIT/4) sym_angle = FIX_ANGLE_UNIT/2 - sym_angle;
+            color = sym_angle * 4 + fix_sin(dist * 8) / 32 +
+                    fix_cos(dist * 3) / 64;
+          }
+          break;
+
+        default:
+          color = (long)rng_below(&rng, FIX(colors - 1)) + FIX_ONE;
+          break;
+      }
+
+      if (step == 1) {
+        out[_x] = quantize(color, colors);
+      } else {
+        memset(out + _x, quantize(color, colors), MIN(step, _width - _x));
+      }
+    }
+
+    /* Each sample fills a step x step block */
+    for (i = 1; i < step && _y + i < a->_height; ++i) {
+      memcpy(out + (size_t)pitch * i, out, _width);
+    }
+  }
+}
+
+static void generate_band(void *arg, int band)
+{
+  const struct gen_int_args *a = arg;
+  int row_begin = band * GEN_BAND_ROWS;
+  int row_end = MIN(row_begin + GEN_BAND_ROWS, (int)a->rows);
+
+  generate_rows(a, row_begin, row_end);
+}
+
+/* An image being drawn, see generate_job_int() */
+struct gen_int_state {
+  struct gen_int_args a;
+  struct gen_job job;
+  int next;                     /* row drawn next by job_step() */
+};
+
+/* Frees the job. Drawing the last row already finished the image. */
+static void end_job(void *arg, int done)
+{
+  struct gen_int_state *st = arg;
+
+  /* The coordinate arrays are allocated together */
+  free(st->a.dx);
+  free(st);
+}
+
+/* Draws the next row of a sliced image, see struct gen_job. Rows of
+ * neighbour dependent functions read the row above, which is always done
+ * when they are drawn in order.
+ */
+static int job_step(void *arg)
+{
+  struct gen_int_state *st = arg;
+
+  generate_rows(&st->a, st->next, st->next + 1);
+  return ++st->next >= (int)st->a.rows;
+}
+
+/* Sets up an image. Returns NULL if out of memory. */
+static struct gen_int_state *new_state(int imageFuncNum,
+                                       UCHAR *buf_graf,
+                                       UINT _xcenter,
+                                       UINT _ycenter,
+                                       UINT _width,
+                                       UINT _height,
+                                       UINT colors,
+                                       UINT pitch,
+                                       UINT normalize,
+                                       UINT step)
+{
+  struct gen_int_state *st;
+  struct gen_int_args *a;
+  struct gen_warp params;
+  long long width, height;
+  long *coords;
+  UINT _x, _y;
+
+  st = malloc(sizeof(*st));
+  coords = malloc((3 * (size_t)_width + 2 * (size_t)_height) * sizeof(long));
+  if (st == NULL || coords == NULL) {
+    free(st);
+    free(coords);
+    return NULL;
+  }
+  a = &st->a;
+
+  a->imageFuncNum = imageFuncNum;
+  a->buf_graf = buf_graf;
+  a->_width = _width;
+  a->_height = _height;
+  a->colors = colors;
+  a->pitch = pitch;
+  a->step = step > 1 ? step : 1;
+  a->rows = (_height + a->step - 1) / a->step;
+  a->dx = coords;
+  a->xa = a->dx + _width;
+  a->y  = a->xa + _width;
+  a->ya = a->y + _height;
+
+  /* Same coordinate space as generate_image_float(). With normalization,
+   * x goes from 0 to 320, and y is scaled the same way, which keeps the
+   * aspect ratio of the original 8:5 display.
+   */
+  if (normalize) {
+    width = FIX(320);
+    height = FIX(320) * _height / _width;
+    a->x_center = (long)(FIX(320) * _xcenter / _width);
+    a->y_center = (long)(FIX(320) * _ycenter / _width);
+  } else {
+    width = FIX(_width);
+    height = FIX(_height);
+    a->x_center = FIX(_xcenter);
+    a->y_center = FIX(_ycenter);
+  }
+
+  for (_x = 0; _x < _width; ++_x) {
+    long x = normalize ? (long)(FIX(320) * (long long)_x / _width) : FIX(_x);
+    a->dx[_x] = x - a->x_center;
+    /* Column position as angle is used by waves */
+    a->xa[_x] = (long)(x * (long long)FIX_ANGLE_UNIT / width);
+  }
+  for (_y = 0; _y < _height; ++_y) {
+    a->y[_y] = normalize ? (long)(FIX(320) * (long long)_y / _width) : FIX(_y);
+    a->ya[_y] = (long)(a->y[_y] * (long long)FIX_ANGLE_UNIT / height);
+  }
+
+  /* Same offsets as generate_image_float(), which are whole numbers unless
+   * they come from a live warp.
+   */
+  generate_params(&params);
+  a->x1 = (long)(params.offsets[0] * FIX_ONE);  a->x2 = (long)(params.offsets[1] * FIX_ONE);
+  a->x3 = (long)(params.offsets[2] * FIX_ONE);  a->x4 = (long)(params.offsets[3] * FIX_ONE);
+  a->y1 = (long)(params.offsets[4] * FIX_ONE);  a->y2 = (long)(params.offsets[5] * FIX_ONE);
+  a->y3 = (long)(params.offsets[6] * FIX_ONE);  a->y4 = (long)(params.offsets[7] * FIX_ONE);
+  a->seed = params.seed;
+
+  return st;
+}
+
+struct gen_job *generate_job_int(int imageFuncNum,
+                                 UCHAR *buf_graf,
+                                 UINT _xcenter,
+                                 UINT _ycenter,
+                                 UINT _width,
+                                 UINT _height,
+                                 UINT colors,
+                                 UINT pitch,
+                                 UINT normalize,
+                                 UINT step)
+{
+  struct gen_int_state *st = new_state(imageFuncNum, buf_graf,
+                                       _xcenter, _ycenter, _width, _height,
+                                       colors, pitch, normalize, step);
+
+  if (st == NULL) {
+    return NULL;
+  }
+  st->job.step = job_step;
+  st->job.arg = st;
+  st->job.status = 0;
+  st->job.end = end_job;
+  st->next = 0;
+  return &st->job;
+}
+
+void generate_image_int(int imageFuncNum,
+                        UCHAR *buf_graf,
+                        UINT _xcenter,
+                        UINT _ycenter,
+                        UINT _width,
+                        UINT _height,
+                        UINT colors,
+                        UINT pitch,
+                        UINT normalize,
+                        UINT step)
+{
+  struct gen_int_state *st = new_state(imageFuncNum, buf_graf,
+                                       _xcenter, _ycenter, _width, _height,
+                                       colors, pitch, normalize, step);
+  int band, bands;
+
+  if (st == NULL) {
+    return;
+  }
+  bands = (st->a.rows + GEN_BAND_ROWS - 1) / GEN_BAND_ROWS;
+
+  /* Neighbour dependent functions read pixels of the previous row, so their
+   * rows cannot be drawn out of order.
+   */
+  switch (imageFuncNum) {
+    case 28: case 29: case 33: case 34:
+      for (band = 0; band < bands; ++band) {
+        generate_band(&st->a, band);
+      }
+      break;
+    default:
+      gen_pool_run(generate_band, &st->a, bands);
+      break;
+  }
+  end_job(st, !abort_draw);
+}
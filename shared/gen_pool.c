@@ -0,0 +1,115 @@
+/* Thread pool for parallel image generation in Acid Warp */
+
+#include <SDL3/SDL.h>
+
+#include "handy.h"
+#include "gen_pool.h"
+
+#define GEN_POOL_MAX_THREADS 64
+
+static int num_threads = 1;
+static SDL_Mutex *pool_mtx = NULL;
+static SDL_Condition *work_cond = NULL;
+static SDL_Condition *done_cond = NULL;
+
+/* Current job, written by gen_pool_run() while holding pool_mtx */
+static gen_pool_job job_func = NULL;
+static void *job_arg = NULL;
+static int job_bands = 0;
+static unsigned int job_generation = 0;
+static int busy_workers = 0;
+static SDL_AtomicInt next_band;
+
+static void run_bands(void)
+{
+  int band;
+
+  while ((band = SDL_AddAtomicInt(&next_band, 1)) < job_bands) {
+    job_func(job_arg, band);
+  }
+}
+
+static int worker_main(void *param)
+{
+  unsigned int seen_generation = 0;
+
+  SDL_LockMutex(pool_mtx);
+  loop {
+    while (job_generation == seen_generation) {
+      SDL_WaitCondition(work_cond, pool_mtx);
+    }
+    seen_generation = job_generation;
+    SDL_UnlockMutex(pool_mtx);
+
+    run_bands();
+
+    SDL_LockMutex(pool_mtx);
+    if (--busy_workers == 0) {
+      SDL_SignalCondition(done_cond);
+    }
+  }
+  return 0;
+}
+
+void gen_pool_init(int threads)
+{
+  int i;
+
+  if (pool_mtx != NULL) return;
+
+  if (threads <= 0) threads = SDL_GetNumLogicalCPUCores();
+  if (threads > GEN_POOL_MAX_THREADS) threads = GEN_POOL_MAX_THREADS;
+  if (threads <= 1) return;
+
+  /* Without a pool, images are still generated on the calling thread */
+  if (!(pool_mtx = SDL_CreateMutex()) ||
+      !(work_cond = SDL_CreateCondition()) ||
+      !(done_cond = SDL_CreateCondition())) {
+    fprintf(stderr, "[GEN] Couldn't create generator pool: %s\n", SDL_GetError());
+    return;
+  }
+
+  /* The thread calling gen_pool_run() is the remaining worker */
+  for (i = 1; i < threads; ++i) {
+    SDL_Thread *thread = SDL_CreateThread(worker_main, "GeneratorThread", NULL);
+    if (thread == NULL) break;
+    SDL_DetachThread(thread);
+    ++num_threads;
+  }
+}
+
+int gen_pool_threads(void)
+{
+  return num_threads;
+}
+
+void gen_pool_run(gen_pool_job job, void *arg, int bands)
+{
+  int band;
+
+  if (num_threads <= 1 || bands <= 1) {
+    for (band = 0; band < bands; ++band) {
+      job(arg, band);
+    }
+    return;
+  }
+
+  SDL_LockMutex(pool_mtx);
+  job_func = job;
+  job_arg = arg;
+  job_bands = bands;
+  SDL_SetAtomicInt(&next_band, 0);
+  busy_workers = num_threads - 1;
+  ++job_generation;
+  SDL_BroadcastCondition(work_cond);
+  SDL_UnlockMutex(pool_mtx);
+
+  run_bands();
+
+  /* Workers may still be finishing the bands they took */
+  SDL_LockMutex(pool_mtx);
+  while (busy_workers > 0) {
+    SDL_WaitCondition(done_cond, pool_mtx);
+  }
+  SDL_UnlockMutex(pool_mtx);
+}
@@ -0,0 +1,39 @@
+/* GEN_POOL.H */
+
+#ifndef GEN_POOL_H
+#define GEN_POOL_H
+
+/* Runs job(arg, band) for every band from 0 to bands - 1. */
+typedef void (*gen_pool_job)(void *arg, int band);
+
+/* Starts the worker threads used for image generation. With threads <= 0,
+ * one thread per logical CPU core is used. Without calling this, jobs run
+ * on the calling thread only.
+ */
+void gen_pool_init(int threads);
+
+/* Returns the number of threads working on each job, including the caller */
+int gen_pool_threads(void);
+
+/* Distributes the bands of a job over the pool and returns once every band
+ * is done. The calling thread works on bands too. Bands are handed out in
+ * increasing order, and a band which was handed out is worked on until it
+ * is done. So a band may wait for progress of lower bands, but never for
+ * higher bands.
+ */
+void gen_pool_run(gen_pool_job job, void *arg, int bands);
+
+/* An image drawn by generate_job_run(). step takes the next step of setting
+ * it up or drawing it, and returns 1 once the image is done, -1 if it could
+ * not be drawn, or otherwise 0, which is kept in status. end frees arg,
+ * after finishing the image if done is set, which is when every step was
+ * taken without drawing being aborted.
+ */
+struct gen_job {
+  int (*step)(void *arg);
+  void *arg;
+  int status;
+  void (*end)(void *arg, int done);
+};
+
+#endif /* GEN_POOL_H */
@@ -26,19 +26,14 @@ typedef int BOOL;
 #endif
 #endif
 
-/* Random number stuff that SHOULD have been there */
+/* Random numbers are in rng.h */
 #include <time.h>
 #include <stdio.h> /* Needed for NULL * */
 #include <stdlib.h>
-#define RANDOMIZE() (srand((UINT)time( (time_t *)NULL )))
-/* This is skewed due to integer division, but
- * good enough when a is much smaller than RAND_MAX.
- */
-#define RANDOM(a) (rand() / (RAND_MAX / (a) + 1))
-#define RANDOMD(a) (rand() / (RAND_MAX / (a) + 1.0))
 
 /* Stuff that's already there, but is faster as a MACRO */
 #define MIN(a,b)  (((a) < (b)) ?  (a) : (b) )
+#define MAX(a,b)  (((a) > (b)) ?  (a) : (b) )
 
 /* This seems nifty to me */
 #define DONE        1
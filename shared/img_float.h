@@ -20,4 +20,27 @@ double lut_cos(double a);
 double lut_angle(double dx, double dy);
 double lut_dist(double x, double y);
 
+/* Vector versions, computing out[i] = lut_sin (a[i]) and so on for n values.
+ * They use SSE2, AVX2 or AVX-512 when the CPU supports it, and polynomial
+ * approximations instead of libm, so results may differ from the scalar
+ * functions in the last bits. Results are the same on every CPU.
+ */
+void lut_sin_v(const double *a, double *out, int n);
+void lut_cos_v(const double *a, double *out, int n);
+void lut_angle_v(const double *dx, double dy, double *out, int n);
+void lut_dist_v(const double *dx, double dy, double *out, int n);
+
+/* Single precision vector versions, with twice as many values per vector */
+void lut_sin_vf(const float *a, float *out, int n);
+void lut_cos_vf(const float *a, float *out, int n);
+void lut_angle_vf(const float *dx, float dy, float *out, int n);
+void lut_dist_vf(const float *dx, float dy, float *out, int n);
+
+/* Name of the instruction set used by the vector functions */
+const char *lut_simd_name(void);
+/* Forces an instruction set by name ("avx512", "avx2", "sse2", "scalar").
+ * Returns 0 if it is unknown or not supported by this CPU.
+ */
+int lut_simd_select(const char *name);
+
 #endif /* IMG_FLOAT_H */
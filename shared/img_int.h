@@ -0,0 +1,24 @@
+/* IMG_INT.H */
+
+#ifndef IMG_INT_H
+#define IMG_INT_H
+
+/* Fixed point versions of the lut functions in img_float.h, using the look
+ * up tables of the original lut.c. They need no FPU and no math library.
+ * Values have FIX_BITS fractional bits, and use the same angle and trig
+ * units as the floating point functions.
+ */
+#define FIX_BITS                    8
+#define FIX_ONE                     (1L << FIX_BITS)
+#define FIX(a)                      ((long)(a) * FIX_ONE)
+
+/* ANGLE_UNIT and TRIG_UNIT of img_float.h, in fixed point */
+#define FIX_ANGLE_UNIT              FIX(255)
+#define FIX_TRIG_UNIT               FIX(511)
+
+long fix_sin(long a);
+long fix_cos(long a);
+long fix_angle(long dx, long dy);
+long fix_dist(long x, long y);
+
+#endif /* IMG_INT_H */
@@ -0,0 +1,323 @@
+/* Vectorized lut functions for Acid Warp, with runtime CPU dispatch */
+
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+#include <math.h>
+#include <string.h>
+
+#include "handy.h"
+#include "img_float.h"
+
+/* Results must not depend on whether the compiler fuses multiplies and
+ * adds, which it may only do on some CPUs.
+ */
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LUT_X86_64 1
+#include <immintrin.h>
+#endif
+
+static void scalar_sin_v(const double *a, double *out, int n);
+static void scalar_cos_v(const double *a, double *out, int n);
+static void scalar_angle_v(const double *dx, double dy, double *out, int n);
+static void scalar_dist_v(const double *dx, double dy, double *out, int n);
+static void scalar_sin_vf(const float *a, float *out, int n);
+static void scalar_cos_vf(const float *a, float *out, int n);
+static void scalar_angle_vf(const float *dx, float dy, float *out, int n);
+static void scalar_dist_vf(const float *dx, float dy, float *out, int n);
+
+/* Portable scalar version, used on other CPUs and for leftover elements */
+#define VEC double
+#define VLEN 1
+#define V_TYPE double
+#define V_TARGET
+#define KERNEL(name) scalar_ ## name
+#define SCALAR(name) scalar_ ## name
+#define V_SET1(x) ((double)(x))
+#define V_LOAD(p) (*(p))
+#define V_STORE(p, v) (*(p) = (v))
+#define V_ADD(a, b) ((a) + (b))
+#define V_SUB(a, b) ((a) - (b))
+#define V_MUL(a, b) ((a) * (b))
+#define V_DIV(a, b) ((a) / (b))
+#define V_SQRT(a) sqrt(a)
+#define V_ABS(a) fabs(a)
+#define V_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define V_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define V_IF_GT(a, b, v) ((a) > (b) ? (v) : 0.0)
+#define V_IF_LE(a, b, v) ((a) <= (b) ? (v) : 0.0)
+#include "img_simd_body.h"
+
+#define VEC float
+#define VLEN 1
+#define V_TYPE float
+#define V_TARGET
+#define KERNEL(name) scalar_ ## name ## f
+#define SCALAR(name) scalar_ ## name ## f
+#define V_SET1(x) ((float)(x))
+#define V_LOAD(p) (*(p))
+#define V_STORE(p, v) (*(p) = (v))
+#define V_ADD(a, b) ((a) + (b))
+#define V_SUB(a, b) ((a) - (b))
+#define V_MUL(a, b) ((a) * (b))
+#define V_DIV(a, b) ((a) / (b))
+#define V_SQRT(a) sqrtf(a)
+#define V_ABS(a) fabsf(a)
+#define V_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define V_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define V_IF_GT(a, b, v) ((a) > (b) ? (v) : 0.0f)
+#define V_IF_LE(a, b, v) ((a) <= (b) ? (v) : 0.0f)
+#include "img_simd_body.h"
+
+#ifdef LUT_X86_64
+
+/* SSE2 is part of every x86-64 CPU */
+#define VEC __m128d
+#define VLEN 2
+#define V_TYPE double
+#define V_TARGET
+#define KERNEL(name) sse2_ ## name
+#define SCALAR(name) scalar_ ## name
+#define V_SET1(x) _mm_set1_pd(x)
+#define V_LOAD(p) _mm_loadu_pd(p)
+#define V_STORE(p, v) _mm_storeu_pd(p, v)
+#define V_ADD(a, b) _mm_add_pd(a, b)
+#define V_SUB(a, b) _mm_sub_pd(a, b)
+#define V_MUL(a, b) _mm_mul_pd(a, b)
+#define V_DIV(a, b) _mm_div_pd(a, b)
+#define V_SQRT(a) _mm_sqrt_pd(a)
+#define V_ABS(a) _mm_andnot_pd(_mm_set1_pd(-0.0), a)
+#define V_MIN(a, b) _mm_min_pd(a, b)
+#define V_MAX(a, b) _mm_max_pd(a, b)
+#define V_IF_GT(a, b, v) _mm_and_pd(_mm_cmpgt_pd(a, b), v)
+#define V_IF_LE(a, b, v) _mm_and_pd(_mm_cmple_pd(a, b), v)
+#include "img_simd_body.h"
+
+#define VEC __m128
+#define VLEN 4
+#define V_TYPE float
+#define V_TARGET
+#define KERNEL(name) sse2_ ## name ## f
+#define SCALAR(name) scalar_ ## name ## f
+#define V_SET1(x) _mm_set1_ps((float)(x))
+#define V_LOAD(p) _mm_loadu_ps(p)
+#define V_STORE(p, v) _mm_storeu_ps(p, v)
+#define V_ADD(a, b) _mm_add_ps(a, b)
+#define V_SUB(a, b) _mm_sub_ps(a, b)
+#define V_MUL(a, b) _mm_mul_ps(a, b)
+#define V_DIV(a, b) _mm_div_ps(a, b)
+#define V_SQRT(a) _mm_sqrt_ps(a)
+#define V_ABS(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define V_MIN(a, b) _mm_min_ps(a, b)
+#define V_MAX(a, b) _mm_max_ps(a, b)
+#define V_IF_GT(a, b, v) _mm_and_ps(_mm_cmpgt_ps(a, b), v)
+#define V_IF_LE(a, b, v) _mm_and_ps(_mm_cmple_ps(a, b), v)
+#include "img_simd_body.h"
+
+#define VEC __m256d
+#define VLEN 4
+#define V_TYPE double
+#define V_TARGET __attribute__((target("avx2")))
+#define KERNEL(name) avx2_ ## name
+#define SCALAR(name) scalar_ ## name
+#define V_SET1(x) _mm256_set1_pd(x)
+#define V_LOAD(p) _mm256_loadu_pd(p)
+#define V_STORE(p, v) _mm256_storeu_pd(p, v)
+#define V_ADD(a, b) _mm256_add_pd(a, b)
+#define V_SUB(a, b) _mm256_sub_pd(a, b)
+#define V_MUL(a, b) _mm256_mul_pd(a, b)
+#define V_DIV(a, b) _mm256_div_pd(a, b)
+#define V_SQRT(a) _mm256_sqrt_pd(a)
+#define V_ABS(a) _mm256_andnot_pd(_mm256_set1_pd(-0.0), a)
+#define V_MIN(a, b) _mm256_min_pd(a, b)
+#define V_MAX(a, b) _mm256_max_pd(a, b)
+#define V_IF_GT(a, b, v) _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ), v)
+#define V_IF_LE(a, b, v) _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_LE_OQ), v)
+#include "img_simd_body.h"
+
+#define VEC __m256
+#define VLEN 8
+#define V_TYPE float
+#define V_TARGET __attribute__((target("avx2")))
+#define KERNEL(name) avx2_ ## name ## f
+#define SCALAR(name) scalar_ ## name ## f
+#define V_SET1(x) _mm256_set1_ps((float)(x))
+#define V_LOAD(p) _mm256_loadu_ps(p)
+#define V_STORE(p, v) _mm256_storeu_ps(p, v)
+#define V_ADD(a, b) _mm256_add_ps(a, b)
+#define V_SUB(a, b) _mm256_sub_ps(a, b)
+#define V_MUL(a, b) _mm256_mul_ps(a, b)
+#define V_DIV(a, b) _mm256_div_ps(a, b)
+#define V_SQRT(a) _mm256_sqrt_ps(a)
+#define V_ABS(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define V_MIN(a, b) _mm256_min_ps(a, b)
+#define V_MAX(a, b) _mm256_max_ps(a, b)
+#define V_IF_GT(a, b, v) _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ), v)
+#define V_IF_LE(a, b, v) _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ), v)
+#include "img_simd_body.h"
+
+#define VEC __m512d
+#define VLEN 8
+#define V_TYPE double
+#define V_TARGET __attribute__((target("avx512f")))
+#define KERNEL(name) avx512_ ## name
+#define SCALAR(name) scalar_ ## name
+#define V_SET1(x) _mm512_set1_pd(x)
+#define V_LOAD(p) _mm512_loadu_pd(p)
+#define V_STORE(p, v) _mm512_storeu_pd(p, v)
+#define V_ADD(a, b) _mm512_add_pd(a, b)
+#define V_SUB(a, b) _mm512_sub_pd(a, b)
+#define V_MUL(a, b) _mm512_mul_pd(a, b)
+#define V_DIV(a, b) _mm512_div_pd(a, b)
+#define V_SQRT(a) _mm512_sqrt_pd(a)
+#define V_ABS(a) _mm512_abs_pd(a)
+#define V_MIN(a, b) _mm512_min_pd(a, b)
+#define V_MAX(a, b) _mm512_max_pd(a, b)
+#define V_IF_GT(a, b, v) _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ), v)
+#define V_IF_LE(a, b, v) _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(a, b, _CMP_LE_OQ), v)
+#include "img_simd_body.h"
+
+#define VEC __m512
+#define VLEN 16
+#define V_TYPE float
+#define V_TARGET __attribute__((target("avx512f")))
+#define KERNEL(name) avx512_ ## name ## f
+#define SCALAR(name) scalar_ ## name ## f
+#define V_SET1(x) _mm512_set1_ps((float)(x))
+#define V_LOAD(p) _mm512_loadu_ps(p)
+#define V_STORE(p, v) _mm512_storeu_ps(p, v)
+#define V_ADD(a, b) _mm512_add_ps(a, b)
+#define V_SUB(a, b) _mm512_sub_ps(a, b)
+#define V_MUL(a, b) _mm512_mul_ps(a, b)
+#define V_DIV(a, b) _mm512_div_ps(a, b)
+#define V_SQRT(a) _mm512_sqrt_ps(a)
+#define V_ABS(a) _mm512_abs_ps(a)
+#define V_MIN(a, b) _mm512_min_ps(a, b)
+#define V_MAX(a, b) _mm512_max_ps(a, b)
+#define V_IF_GT(a, b, v) _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a, b, _CMP_GT_OQ), v)
+#define V_IF_LE(a, b, v) _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a, b, _CMP_LE_OQ), v)
+#include "img_simd_body.h"
+
+#endif /* LUT_X86_64 */
+
+struct lut_kernels {
+  const char *name;
+  void (*sin_v)(const double *a, double *out, int n);
+  void (*cos_v)(const double *a, double *out, int n);
+  void (*angle_v)(const double *dx, double dy, double *out, int n);
+  void (*dist_v)(const double *dx, double dy, double *out, int n);
+  void (*sin_vf)(const float *a, float *out, int n);
+  void (*cos_vf)(const float *a, float *out, int n);
+  void (*angle_vf)(const float *dx, float dy, float *out, int n);
+  void (*dist_vf)(const float *dx, float dy, float *out, int n);
+};
+
+static const struct lut_kernels all_kernels[] = {
+#ifdef LUT_X86_64
+  { "avx512", avx512_sin_v, avx512_cos_v, avx512_angle_v, avx512_dist_v,
+    avx512_sin_vf, avx512_cos_vf, avx512_angle_vf, avx512_dist_vf },
+  { "avx2", avx2_sin_v, avx2_cos_v, avx2_angle_v, avx2_dist_v,
+    avx2_sin_vf, avx2_cos_vf, avx2_angle_vf, avx2_dist_vf },
+  { "sse2", sse2_sin_v, sse2_cos_v, sse2_angle_v, sse2_dist_v,
+    sse2_sin_vf, sse2_cos_vf, sse2_angle_vf, sse2_dist_vf },
+#endif
+  { "scalar", scalar_sin_v, scalar_cos_v, scalar_angle_v, scalar_dist_v,
+    scalar_sin_vf, scalar_cos_vf, scalar_angle_vf, scalar_dist_vf }
+};
+#define NUM_KERNELS ((int)(sizeof(all_kernels) / sizeof(all_kernels[0])))
+
+static const struct lut_kernels *kernels = NULL;
+
+static int kernels_supported(const struct lut_kernels *k)
+{
+#ifdef LUT_X86_64
+  __builtin_cpu_init();
+  if (!strcmp(k->name, "avx512")) return __builtin_cpu_supports("avx512f");
+  if (!strcmp(k->name, "avx2")) return __builtin_cpu_supports("avx2");
+#endif
+  return 1;
+}
+
+/* Picks the widest supported instruction set. Every thread picks the
+ * same one, so a race here is harmless.
+ */
+static const struct lut_kernels *get_kernels(void)
+{
+  const struct lut_kernels *k = kernels;
+  int i;
+
+  if (k == NULL) {
+    for (i = 0; i < NUM_KERNELS; ++i) {
+      if (kernels_supported(&all_kernels[i])) {
+        k = &all_kernels[i];
+        break;
+      }
+    }
+    kernels = k;
+  }
+  return k;
+}
+
+int lut_simd_select(const char *name)
+{
+  int i;
+
+  for (i = 0; i < NUM_KERNELS; ++i) {
+    if (!strcmp(all_kernels[i].name, name) && kernels_supported(&all_kernels[i])) {
+      kernels = &all_kernels[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+const char *lut_simd_name(void)
+{
+  return get_kernels()->name;
+}
+
+void lut_sin_v (const double *a, double *out, int n)
+{
+  get_kernels()->sin_v(a, out, n);
+}
+
+void lut_cos_v (const double *a, double *out, int n)
+{
+  get_kernels()->cos_v(a, out, n);
+}
+
+void lut_angle_v (const double *dx, double dy, double *out, int n)
+{
+  get_kernels()->angle_v(dx, dy, out, n);
+}
+
+void lut_dist_v (const double *dx, double dy, double *out, int n)
+{
+  get_kernels()->dist_v(dx, dy, out, n);
+}
+
+void lut_sin_vf (const float *a, float *out, int n)
+{
+  get_kernels()->sin_vf(a, out, n);
+}
+
+void lut_cos_vf (const float *a, float *out, int n)
+{
+  get_kernels()->cos_vf(a, out, n);
+}
+
+void lut_angle_vf (const float *dx, float dy, float *out, int n)
+{
+  get_kernels()->angle_vf(dx, dy, out, n);
+}
+
+void lut_dist_vf (const float *dx, float dy, float *out, int n)
+{
+  get_kernels()->dist_vf(dx, dy, out, n);
+}
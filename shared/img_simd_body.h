@@ -0,0 +1,160 @@
+/* Vector lut kernels for Acid Warp, included by img_simd.c once for every
+ * instruction set and precision. The includer defines VEC, VLEN, V_TYPE
+ * (double or float), V_TARGET, KERNEL(name), SCALAR(name) for the scalar
+ * kernel of the same precision, and the V_ operations below. Every
+ * instruction set performs exactly the same operations in the same order,
+ * so all of them return bit-identical results and images don't depend on
+ * the CPU they were generated on.
+ *
+ * V_IF_GT (a, b, v) returns v where a > b and 0 elsewhere, and V_IF_LE
+ * returns v where a <= b. Adding both is used to select between values.
+ * All of these macros are undefined again at the end of this file.
+ */
+
+/* Round to nearest even, valid for |x| < 2^51 for double and 2^22 for
+ * float. Adding 1.5 times 2^52 or 2^23 drops the fraction bits.
+ */
+static inline V_TARGET VEC KERNEL(round) (VEC x)
+{
+  const double magic = sizeof (V_TYPE) == sizeof (float) ?
+                       12582912.0 : 6755399441055744.0;
+  return V_SUB(V_ADD(x, V_SET1(magic)), V_SET1(magic));
+}
+
+/* sin (a * M_PI * 2 / ANGLE_UNIT) when cosine is 0,
+ * cos (a * M_PI * 2 / ANGLE_UNIT) when cosine is 1.
+ */
+static inline V_TARGET VEC KERNEL(sincos) (VEC a, int cosine)
+{
+  /* Reduce to r in [-M_PI/4, M_PI/4] and the quarter turn q in 0 to 3 */
+  VEC t = V_MUL(a, V_SET1(4.0 / ANGLE_UNIT));
+  VEC n = KERNEL(round)(t);
+  VEC r = V_MUL(V_SUB(t, n), V_SET1(M_PI / 2));
+  VEC k = KERNEL(round)(V_SUB(V_MUL(n, V_SET1(0.25)), V_SET1(0.375)));
+  VEC q = V_SUB(n, V_MUL(k, V_SET1(4.0)));
+  VEC h = KERNEL(round)(V_SUB(V_MUL(q, V_SET1(0.5)), V_SET1(0.25)));
+  VEC e = V_SUB(q, V_MUL(h, V_SET1(2.0)));
+  VEC sign = V_SUB(V_SET1(1.0), V_MUL(h, V_SET1(2.0)));
+  /* sin (x) = s * ca + c * sa, cos (x) = c * ca - s * sa */
+  VEC ca = V_MUL(V_SUB(V_SET1(1.0), e), sign);
+  VEC sa = V_MUL(e, sign);
+  VEC z = V_MUL(r, r);
+  VEC s, c;
+
+  /* Minimax polynomials for |r| <= M_PI/4 from fdlibm */
+  s = V_ADD(V_MUL(z, V_SET1(1.58969099521155010221e-10)), V_SET1(-2.50507602534068634195e-08));
+  s = V_ADD(V_MUL(z, s), V_SET1(2.75573137070700676789e-06));
+  s = V_ADD(V_MUL(z, s), V_SET1(-1.98412698298579493134e-04));
+  s = V_ADD(V_MUL(z, s), V_SET1(8.33333333332248946124e-03));
+  s = V_ADD(V_MUL(z, s), V_SET1(-1.66666666666666324348e-01));
+  s = V_ADD(r, V_MUL(V_MUL(z, r), s));
+
+  c = V_ADD(V_MUL(z, V_SET1(-1.13596475577881948265e-11)), V_SET1(2.08757232129817482790e-09));
+  c = V_ADD(V_MUL(z, c), V_SET1(-2.75573143513906633035e-07));
+  c = V_ADD(V_MUL(z, c), V_SET1(2.48015872894767294178e-05));
+  c = V_ADD(V_MUL(z, c), V_SET1(-1.38888888888741095749e-03));
+  c = V_ADD(V_MUL(z, c), V_SET1(4.16666666666666019037e-02));
+  c = V_ADD(V_SUB(V_SET1(1.0), V_MUL(z, V_SET1(0.5))), V_MUL(V_MUL(z, z), c));
+
+  if (cosine) {
+    return V_SUB(V_MUL(c, ca), V_MUL(s, sa));
+  }
+  return V_ADD(V_MUL(s, ca), V_MUL(c, sa));
+}
+
+/* lut_angle (dx, dy) */
+static inline V_TARGET VEC KERNEL(angle) (VEC dx, VEC dy)
+{
+  const VEC zero = V_SET1(0.0);
+  VEC ax = V_ABS(dx), ay = V_ABS(dy);
+  VEC mx = V_MAX(ax, ay), mn = V_MIN(ax, ay);
+  VEC t, tr, z, p, q, a;
+
+  /* 0 / 0 is avoided, atan2 (0, 0) is 0 */
+  mx = V_ADD(mx, V_IF_LE(mx, zero, V_SET1(1.0)));
+  t = V_DIV(mn, mx);
+
+  /* atan (t) for 0 <= t <= 1, rational approximation from Cephes */
+  tr = V_ADD(V_IF_GT(t, V_SET1(0.66), V_DIV(V_SUB(t, V_SET1(1.0)), V_ADD(t, V_SET1(1.0)))),
+             V_IF_LE(t, V_SET1(0.66), t));
+  z = V_MUL(tr, tr);
+  p = V_ADD(V_MUL(z, V_SET1(-8.750608600031904122785e-01)), V_SET1(-1.615753718733365076637e+01));
+  p = V_ADD(V_MUL(z, p), V_SET1(-7.500855792314704667340e+01));
+  p = V_ADD(V_MUL(z, p), V_SET1(-1.228866684490136173410e+02));
+  p = V_ADD(V_MUL(z, p), V_SET1(-6.485021904942025371773e+01));
+  q = V_ADD(z, V_SET1(2.485846490142306297962e+01));
+  q = V_ADD(V_MUL(z, q), V_SET1(1.650270098316988542046e+02));
+  q = V_ADD(V_MUL(z, q), V_SET1(4.328810604912902668951e+02));
+  q = V_ADD(V_MUL(z, q), V_SET1(4.853903996359136964868e+02));
+  q = V_ADD(V_MUL(z, q), V_SET1(1.945506571482613964425e+02));
+  a = V_ADD(V_MUL(tr, V_DIV(V_MUL(z, p), q)), tr);
+  a = V_ADD(V_IF_GT(t, V_SET1(0.66), V_SET1(M_PI / 4)),
+            V_ADD(a, V_IF_GT(t, V_SET1(0.66), V_SET1(0.5 * 6.123233995736765886130e-17))));
+
+  /* Unfold octants */
+  a = V_ADD(V_IF_GT(ay, ax, V_SUB(V_SET1(M_PI / 2), a)), V_IF_LE(ay, ax, a));
+  a = V_ADD(V_IF_GT(zero, dx, V_SUB(V_SET1(M_PI), a)), V_IF_LE(zero, dx, a));
+  a = V_ADD(V_IF_GT(zero, dy, V_SUB(zero, a)), V_IF_LE(zero, dy, a));
+
+  a = V_DIV(V_MUL(a, V_SET1(ANGLE_UNIT)), V_SET1(M_PI * 2));
+  /* Always return a positive result */
+  return V_ADD(a, V_IF_GT(zero, a, V_SET1(ANGLE_UNIT_2)));
+}
+
+static V_TARGET void KERNEL(sin_v) (const V_TYPE *a, V_TYPE *out, int n)
+{
+  int i;
+  for (i = 0; i + VLEN <= n; i += VLEN) {
+    V_STORE(out + i, V_MUL(V_SET1(TRIG_UNIT), KERNEL(sincos)(V_LOAD(a + i), 0)));
+  }
+  if (i < n) SCALAR(sin_v)(a + i, out + i, n - i);
+}
+
+static V_TARGET void KERNEL(cos_v) (const V_TYPE *a, V_TYPE *out, int n)
+{
+  int i;
+  for (i = 0; i + VLEN <= n; i += VLEN) {
+    V_STORE(out + i, V_MUL(V_SET1(TRIG_UNIT), KERNEL(sincos)(V_LOAD(a + i), 1)));
+  }
+  if (i < n) SCALAR(cos_v)(a + i, out + i, n - i);
+}
+
+static V_TARGET void KERNEL(angle_v) (const V_TYPE *dx, V_TYPE dy, V_TYPE *out, int n)
+{
+  int i;
+  for (i = 0; i + VLEN <= n; i += VLEN) {
+    V_STORE(out + i, KERNEL(angle)(V_LOAD(dx + i), V_SET1(dy)));
+  }
+  if (i < n) SCALAR(angle_v)(dx + i, dy, out + i, n - i);
+}
+
+static V_TARGET void KERNEL(dist_v) (const V_TYPE *dx, V_TYPE dy, V_TYPE *out, int n)
+{
+  const VEC dy2 = V_MUL(V_SET1(dy), V_SET1(dy));
+  int i;
+  for (i = 0; i + VLEN <= n; i += VLEN) {
+    VEC x = V_LOAD(dx + i);
+    V_STORE(out + i, V_SQRT(V_ADD(V_MUL(x, x), dy2)));
+  }
+  if (i < n) SCALAR(dist_v)(dx + i, dy, out + i, n - i);
+}
+
+#undef VEC
+#undef VLEN
+#undef V_TYPE
+#undef V_TARGET
+#undef KERNEL
+#undef SCALAR
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_ABS
+#undef V_MIN
+#undef V_MAX
+#undef V_IF_GT
+#undef V_IF_LE
@@ -0,0 +1,52 @@
+/* Parameter movement for live warp mode */
+
+#include <math.h>
+
+#include "handy.h"
+#include "acidwarp.h"
+#include "live.h"
+#include "rng.h"
+
+/* Offsets swing this far either way. Random offsets are from -20 to 19. */
+#define LIVE_OFFSET_SWING 12.0
+/* The centre swings this part of the image size either way */
+#define LIVE_CENTER_SWING 0.125
+
+#define LIVE_TWO_PI 6.283185307179586
+
+void live_begin(struct live_warp *l)
+{
+  int i;
+
+  generate_set_warp(NULL);
+  generate_params(&l->base);
+  for (i = 0; i < 10; ++i) {
+    l->phase[i] = rng_double(&rng_draw, LIVE_TWO_PI);
+    /* Offsets take 6 to 20 seconds per swing, and the centre 20 to 60 */
+    l->speed[i] = i < 8 ? 0.3 + rng_double(&rng_draw, 0.7)
+                        : 0.1 + rng_double(&rng_draw, 0.2);
+  }
+  l->t = 0.0;
+}
+
+static double swing(const struct live_warp *l, int i)
+{
+  return sin(l->phase[i] + l->speed[i] * l->t);
+}
+
+void live_frame(struct live_warp *l, double seconds, UINT width, UINT height,
+                struct gen_warp *warp, UINT *xcenter, UINT *ycenter)
+{
+  int i;
+
+  l->t += seconds;
+  for (i = 0; i < 8; ++i) {
+    warp->offsets[i] = l->base.offsets[i] + LIVE_OFFSET_SWING * swing(l, i);
+  }
+  /* Pixels drawn at random are the same in every frame, instead of
+   * flickering.
+   */
+  warp->seed = l->base.seed;
+  *xcenter = (UINT)(width * (0.5 + LIVE_CENTER_SWING * swing(l, 8)));
+  *ycenter = (UINT)(height * (0.5 + LIVE_CENTER_SWING * swing(l, 9)));
+}
@@ -0,0 +1,34 @@
+/* LIVE.H */
+
+#ifndef LIVE_H
+#define LIVE_H
+
+/* Live warp mode keeps regenerating the image while it is shown, with its
+ * random offsets and centre slowly drifting, so the pattern itself moves
+ * instead of only the palette. Every parameter swings around a random
+ * starting point along its own sine wave.
+ */
+
+/* Image size relative to the window used by default in live warp mode,
+ * so frames are drawn fast enough to keep up with the palette.
+ */
+#define LIVE_RENDER_SCALE 0.5f
+
+struct live_warp {
+  struct gen_warp base;         /* parameters the offsets swing around */
+  double phase[10], speed[10];  /* x1..x4, y1..y4, then the centre */
+  double t;                     /* seconds of movement so far */
+};
+
+/* Starts moving a new image, taking random numbers from rng_draw like
+ * the generate_image_*() functions do.
+ */
+void live_begin(struct live_warp *l);
+
+/* Moves on by seconds, and returns the parameters and centre of the next
+ * frame of an image of width x height pixels.
+ */
+void live_frame(struct live_warp *l, double seconds, UINT width, UINT height,
+                struct gen_warp *warp, UINT *xcenter, UINT *ycenter);
+
+#endif /* LIVE_H */
@@ -0,0 +1,420 @@
+/* Cached per pixel polar coordinates for Acid Warp image generation */
+
+#include <stdlib.h>
+
+#include "handy.h"
+#include "acidwarp.h"
+#include "img_float.h"
+#include "gen_pool.h"
+#include "polar.h"
+
+#define POLAR_BAND_ROWS 16
+/* Most doubles in a vector of the lut kernels */
+#define POLAR_ALIGN 8
+/* Columns polar_field_row_float() converts at a time */
+#define POLAR_CHUNK 256
+
+/* Largest field whose distances and angles are cached, 133 MB in double
+ * precision. Larger images, such as 8K walls, compute them a row at a time
+ * instead, which keeps memory close to the image itself.
+ */
+#define POLAR_MAX_PIXELS (3840 * 2160)
+
+static struct polar_field field = { 0 };
+/* Set once the per column and per row arrays are allocated for the size */
+static int field_set = 0;
+/* Rows of the field built so far, in order unless it is built by bands,
+ * in the precision it is kept in
+ */
+static UINT field_rows = 0;
+static UINT wide_rows = 0;
+static UINT wide_float_rows = 0;
+/* dx per column of the wide field, followed by a row of distances */
+static double *wide_dx = NULL;
+static double view_zoom = 1.0, view_x = 0.0, view_y = 0.0;
+
+/* Frees the per pixel arrays, in both precisions */
+static void free_pixels(struct polar_field *f)
+{
+  free(f->dist);
+  free(f->angle);
+  f->dist = f->angle = NULL;
+  free(f->x_f);
+  free(f->dx_f);
+  free(f->dist_f);
+  free(f->angle_f);
+  f->x_f = f->dx_f = f->dist_f = f->angle_f = NULL;
+}
+
+static void polar_field_free(struct polar_field *f)
+{
+  free(f->x);
+  free(f->y);
+  free(f->dx);
+  f->x = f->y = f->dx = NULL;
+  free_pixels(f);
+  free(f->dist_wide);
+  free(f->dist_wide_f);
+  f->dist_wide = NULL;
+  f->dist_wide_f = NULL;
+}
+
+void polar_field_row(const struct polar_field *f, UINT _y, UINT x0, UINT x1,
+                     double *dist, double *angle)
+{
+  double dy = f->y[_y] - f->y_center;
+
+  /* Vector kernels compute the last columns of a row which do not fill a
+   * vector differently, so the columns are aligned like whole rows
+   */
+  x0 &= ~(POLAR_ALIGN - 1);
+  x1 = MIN((x1 + POLAR_ALIGN - 1) & ~(POLAR_ALIGN - 1), f->_width);
+  lut_dist_v(f->dx + x0, dy, dist + x0, x1 - x0);
+  lut_angle_v(f->dx + x0, dy, angle + x0, x1 - x0);
+}
+
+void polar_field_row_float(const struct polar_field *f, UINT _y,
+                           UINT x0, UINT x1, float *dist, float *angle)
+{
+  double d[POLAR_CHUNK], a[POLAR_CHUNK];
+  UINT _x, end, i;
+
+  /* Converted in chunks which keep the alignment of polar_field_row() */
+  for (_x = x0 & ~(POLAR_ALIGN - 1); _x < x1; _x = end) {
+    end = MIN(_x + POLAR_CHUNK, x1);
+    polar_field_row(f, _y, _x, end, d - _x, a - _x);
+    end = MIN((end + POLAR_ALIGN - 1) & ~(POLAR_ALIGN - 1), f->_width);
+    for (i = _x; i < end; ++i) {
+      dist[i] = (float)d[i - _x];
+      angle[i] = (float)a[i - _x];
+    }
+  }
+}
+
+/* Whether the per pixel arrays are kept in this precision */
+static int has_pixels(const struct polar_field *f, int single)
+{
+  return single ? f->dist_f != NULL : f->dist != NULL;
+}
+
+/* Builds row _y in whichever precision the field is kept */
+static void build_row(struct polar_field *f, UINT _y)
+{
+  size_t row = (size_t)_y * f->_width;
+
+  if (f->dist != NULL) {
+    polar_field_row(f, _y, 0, f->_width, f->dist + row, f->angle + row);
+  } else {
+    polar_field_row_float(f, _y, 0, f->_width,
+                          f->dist_f + row, f->angle_f + row);
+  }
+}
+
+static void build_band(void *arg, int band)
+{
+  struct polar_field *f = arg;
+  UINT _y_end = MIN((band + 1) * POLAR_BAND_ROWS, f->_height);
+  UINT _y;
+
+  /* A field being abandoned is not completed */
+  if (abort_draw) return;
+  for (_y = band * POLAR_BAND_ROWS; _y < _y_end; ++_y) {
+    build_row(f, _y);
+  }
+}
+
+static void to_float(const double *in, float *out, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i) out[i] = (float)in[i];
+}
+
+/* What build_wide_band() needs besides the field */
+struct wide_args {
+  struct polar_field *f;
+  const double *dx;             /* per column of the wide field */
+  UINT width, height;           /* of the wide field */
+  int single;
+  int failed;                   /* set by bands out of memory */
+};
+
+/* Builds row _y of the wide field, using dist for a row of distances in
+ * single precision
+ */
+static void wide_row(const struct wide_args *w, UINT _y, double *dist)
+{
+  struct polar_field *f = w->f;
+  double dy = polar_y(f, (int)_y - (int)f->margin_y) - f->y_center;
+  size_t row = (size_t)_y * w->width;
+
+  if (w->single) {
+    /* Converted like dist_f */
+    lut_dist_v(w->dx, dy, dist, w->width);
+    to_float(dist, f->dist_wide_f + row, w->width);
+  } else {
+    lut_dist_v(w->dx, dy, f->dist_wide + row, w->width);
+  }
+}
+
+static void build_wide_band(void *arg, int band)
+{
+  struct wide_args *w = arg;
+  UINT _y_end = MIN((band + 1) * POLAR_BAND_ROWS, w->height);
+  double *dist = w->single ? malloc(w->width * sizeof(double)) : NULL;
+  UINT _y;
+
+  if (w->single && dist == NULL) w->failed = 1;
+  if (abort_draw || w->failed) {
+    free(dist);
+    return;
+  }
+  for (_y = band * POLAR_BAND_ROWS; _y < _y_end; ++_y) {
+    wide_row(w, _y, dist);
+  }
+  free(dist);
+}
+
+/* The wide field being built, in the precision asked for */
+static void wide_args(struct wide_args *w, int single)
+{
+  w->f = &field;
+  w->dx = wide_dx;
+  w->width = field._width + 2 * field.margin_x;
+  w->height = field._height + 2 * field.margin_y;
+  w->single = single;
+  w->failed = 0;
+}
+
+void polar_set_view(double zoom, double pan_x, double pan_y)
+{
+  view_zoom = zoom;
+  view_x = pan_x;
+  view_y = pan_y;
+}
+
+void polar_field_params(struct polar_field *f, UINT _width, UINT _height,
+                        UINT _xcenter, UINT _ycenter, UINT normalize)
+{
+  f->_width = _width;
+  f->_height = _height;
+  f->_xcenter = _xcenter;
+  f->_ycenter = _ycenter;
+  f->normalize = normalize ? 1 : 0;
+
+  // Original DOS version targeted 8:5 display (320x200) but also supported 4:3 displays.
+  // It appears during the SDL port that added floating point conversion, it assumed a 8:5 display ratio.
+  // Apply the necessary correction here:
+  f->aspect_correction = (8.0 / 5.0) / ((double)_width / (double)_height);
+
+  if (normalize) {
+    f->x_center = (_xcenter * 320.0) / (double)_width;
+    f->y_center = (_ycenter * 200.0 * f->aspect_correction) / (double)_height;
+    f->width = 320.0;
+    f->height = 200.0 * f->aspect_correction;
+  } else {
+    f->x_center = _xcenter;
+    f->y_center = _ycenter;
+    f->width = _width;
+    f->height = _height;
+  }
+
+  f->zoom = view_zoom;
+  f->pan_x = view_x;
+  f->pan_y = view_y;
+}
+
+const struct polar_field *polar_field_begin(UINT _width, UINT _height,
+                                            UINT _xcenter, UINT _ycenter,
+                                            UINT normalize, int single)
+{
+  struct polar_field *f = &field;
+  size_t pixels = (size_t)_width * _height;
+  UINT _x, _y;
+
+  normalize = normalize ? 1 : 0;
+  if (!field_set || f->_width != _width || f->_height != _height ||
+      f->_xcenter != _xcenter || f->_ycenter != _ycenter ||
+      f->normalize != normalize || f->zoom != view_zoom ||
+      f->pan_x != view_x || f->pan_y != view_y) {
+    field_rows = 0;
+    wide_rows = 0;
+    wide_float_rows = 0;
+    if (!field_set || f->_width != _width || f->_height != _height) {
+      polar_field_free(f);
+      f->x = malloc(_width * sizeof(double));
+      f->y = malloc(_height * sizeof(double));
+      f->dx = malloc(_width * sizeof(double));
+      if (f->x == NULL || f->y == NULL || f->dx == NULL) {
+        polar_field_free(f);
+      }
+      field_set = f->x != NULL;
+    }
+
+    polar_field_params(f, _width, _height, _xcenter, _ycenter, normalize);
+
+    if (!field_set) {
+      /* Callers compute coordinates themselves */
+      return f;
+    }
+
+    for (_x = 0; _x < _width; ++_x) {
+      f->x[_x] = polar_x(f, _x);
+      f->dx[_x] = f->x[_x] - f->x_center;
+    }
+    for (_y = 0; _y < _height; ++_y) {
+      f->y[_y] = polar_y(f, _y);
+    }
+    if (f->x_f != NULL) {
+      to_float(f->x, f->x_f, _width);
+      to_float(f->dx, f->dx_f, _width);
+    }
+  }
+
+  /* Without them, callers compute distances and angles per row */
+  if (!field_set || pixels > POLAR_MAX_PIXELS || has_pixels(f, single)) {
+    return f;
+  }
+
+  /* Only the precision asked for is kept. Single precision is converted
+   * from double precision, which is more accurate than the single
+   * precision lut functions.
+   */
+  free_pixels(f);
+  field_rows = 0;
+  if (single) {
+    f->x_f = malloc(_width * sizeof(float));
+    f->dx_f = malloc(_width * sizeof(float));
+    f->dist_f = malloc(pixels * sizeof(float));
+    f->angle_f = malloc(pixels * sizeof(float));
+    if (f->x_f == NULL || f->dx_f == NULL ||
+        f->dist_f == NULL || f->angle_f == NULL) {
+      free_pixels(f);
+      return f;
+    }
+    to_float(f->x, f->x_f, _width);
+    to_float(f->dx, f->dx_f, _width);
+  } else {
+    f->dist = malloc(pixels * sizeof(double));
+    f->angle = malloc(pixels * sizeof(double));
+    if (f->dist == NULL || f->angle == NULL) free_pixels(f);
+  }
+  return f;
+}
+
+int polar_field_build_row(int single)
+{
+  struct polar_field *f = &field;
+
+  if (!has_pixels(f, single)) return 1;
+  if (field_rows < f->_height) {
+    build_row(f, field_rows++);
+  }
+  return field_rows == f->_height;
+}
+
+/* polar_field_get() in either precision */
+static const struct polar_field *field_get(UINT _width, UINT _height,
+                                           UINT _xcenter, UINT _ycenter,
+                                           UINT normalize, int single)
+{
+  struct polar_field *f =
+    (struct polar_field *)polar_field_begin(_width, _height, _xcenter,
+                                            _ycenter, normalize, single);
+
+  if (has_pixels(f, single) && field_rows < _height) {
+    gen_pool_run(build_band, f, (_height + POLAR_BAND_ROWS - 1) / POLAR_BAND_ROWS);
+    /* Bands may have been skipped anywhere */
+    field_rows = abort_draw ? 0 : _height;
+  }
+  return f;
+}
+
+const struct polar_field *polar_field_get(UINT _width, UINT _height,
+                                          UINT _xcenter, UINT _ycenter,
+                                          UINT normalize)
+{
+  return field_get(_width, _height, _xcenter, _ycenter, normalize, 0);
+}
+
+const struct polar_field *polar_field_get_float(UINT _width, UINT _height,
+                                                UINT _xcenter, UINT _ycenter,
+                                                UINT normalize)
+{
+  return field_get(_width, _height, _xcenter, _ycenter, normalize, 1);
+}
+
+int polar_field_widen_begin(UINT margin_x, UINT margin_y, int single)
+{
+  struct polar_field *f = &field;
+  struct wide_args w;
+  double *dx;
+  size_t pixels;
+  int _x;
+
+  if (!has_pixels(f, single) || field_rows < f->_height) return 0;
+  if (f->margin_x != margin_x || f->margin_y != margin_y) {
+    wide_rows = 0;
+    wide_float_rows = 0;
+    free(f->dist_wide);
+    free(f->dist_wide_f);
+    f->dist_wide = NULL;
+    f->dist_wide_f = NULL;
+    f->margin_x = margin_x;
+    f->margin_y = margin_y;
+  }
+
+  wide_args(&w, single);
+  pixels = (size_t)w.width * w.height;
+  /* Like the field, only the precision asked for is kept */
+  if (single && f->dist_wide_f == NULL) {
+    free(f->dist_wide);
+    f->dist_wide = NULL;
+    wide_rows = 0;
+    f->dist_wide_f = malloc(pixels * sizeof(float));
+    if (f->dist_wide_f == NULL) return 0;
+  } else if (!single && f->dist_wide == NULL) {
+    free(f->dist_wide_f);
+    f->dist_wide_f = NULL;
+    wide_float_rows = 0;
+    f->dist_wide = malloc(pixels * sizeof(double));
+    if (f->dist_wide == NULL) return 0;
+  }
+
+  dx = realloc(wide_dx, 2 * (size_t)w.width * sizeof(double));
+  if (dx == NULL) return 0;
+  wide_dx = dx;
+  for (_x = 0; _x < (int)w.width; ++_x) {
+    dx[_x] = polar_x(f, _x - (int)margin_x) - f->x_center;
+  }
+  return 1;
+}
+
+int polar_field_widen_row(int single)
+{
+  UINT *rows = single ? &wide_float_rows : &wide_rows;
+  struct wide_args w;
+
+  wide_args(&w, single);
+  if (*rows < w.height) {
+    wide_row(&w, (*rows)++, wide_dx + w.width);
+  }
+  return *rows == w.height;
+}
+
+int polar_field_widen(UINT margin_x, UINT margin_y, int single)
+{
+  UINT *rows = single ? &wide_float_rows : &wide_rows;
+  struct wide_args w;
+
+  if (!polar_field_widen_begin(margin_x, margin_y, single)) return 0;
+  wide_args(&w, single);
+  if (*rows < w.height) {
+    gen_pool_run(build_wide_band, &w, (w.height + POLAR_BAND_ROWS - 1) / POLAR_BAND_ROWS);
+    if (abort_draw || w.failed) {
+      *rows = 0;
+      return 0;
+    }
+    *rows = w.height;
+  }
+  return 1;
+}
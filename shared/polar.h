@@ -0,0 +1,135 @@
+/* POLAR.H */
+
+#ifndef POLAR_H
+#define POLAR_H
+
+/* Coordinates of every pixel relative to the image centre, which only
+ * depend on the image size, the centre and normalization. They are kept
+ * between images and rebuilt only when one of those changes, eg. after
+ * the display is resized.
+ */
+struct polar_field {
+  /* Parameters the field was built for */
+  UINT _width, _height;
+  UINT _xcenter, _ycenter;
+  UINT normalize;
+
+  /* Image size and centre in the coordinate space used by image functions */
+  double width, height;
+  double x_center, y_center;
+  double aspect_correction;
+
+  /* View of the explorer, see polar_set_view() */
+  double zoom, pan_x, pan_y;
+
+  double *x;      /* per column */
+  double *y;      /* per row */
+  double *dx;     /* per column, x - x_center */
+  double *dist;   /* per pixel, _width * _height, lut_dist (dx, dy) */
+  double *angle;  /* per pixel, _width * _height, lut_angle (dx, dy) */
+
+  /* Single precision copies of x, dx, dist and angle. Only the per pixel
+   * arrays of the precision last asked for are kept, and those of the
+   * other precision are NULL.
+   */
+  float *x_f, *dx_f, *dist_f, *angle_f;
+
+  /* Distance of every pixel of the image and of a margin of margin_x
+   * columns and margin_y rows around it, _width + 2 * margin_x per row,
+   * only built when widened, see polar_field_widen(). Reading it at an
+   * offset gives the distance from a centre shifted by whole pixels.
+   * Only the precision asked for last is kept, the other is NULL.
+   */
+  UINT margin_x, margin_y;
+  double *dist_wide;
+  float *dist_wide_f;
+};
+
+/* Coordinates of pixel column _x and row _y, as used by image functions.
+ * Columns and rows outside the image continue the same way.
+ */
+static inline double polar_x(const struct polar_field *f, int _x)
+{
+  double x = f->normalize ? (double)(_x * 320) / f->_width : _x;
+  if (f->zoom != 1.0 || f->pan_x != 0.0) {
+    x = f->x_center + (x - f->x_center) / f->zoom + f->pan_x;
+  }
+  return x;
+}
+
+static inline double polar_y(const struct polar_field *f, int _y)
+{
+  double y = f->normalize ?
+             (double)(_y * 200 * f->aspect_correction) / f->_height : _y;
+  if (f->zoom != 1.0 || f->pan_y != 0.0) {
+    y = f->y_center + (y - f->y_center) / f->zoom + f->pan_y;
+  }
+  return y;
+}
+
+/* Magnifies the coordinates of fields set up from now on by zoom about
+ * the centre of the image, and moves them so pan_x, pan_y from the centre
+ * of image functions is shown at the centre of the image. 1, 0, 0 is the
+ * normal view.
+ */
+void polar_set_view(double zoom, double pan_x, double pan_y);
+
+/* Returns the field for these parameters, building it if needed. If memory
+ * for it could not be allocated, the per column, row and pixel arrays are
+ * NULL. Only the per pixel arrays are NULL for images too large to cache
+ * them. The field stays valid until the next call with different parameters
+ * or precision.
+ */
+const struct polar_field *polar_field_get(UINT _width, UINT _height,
+                                          UINT _xcenter, UINT _ycenter,
+                                          UINT normalize);
+
+/* Same as polar_field_get(), but also builds the single precision copies.
+ * If memory for them could not be allocated, they are NULL.
+ */
+const struct polar_field *polar_field_get_float(UINT _width, UINT _height,
+                                                UINT _xcenter, UINT _ycenter,
+                                                UINT normalize);
+
+/* Same as polar_field_get(), or polar_field_get_float() if single is set,
+ * but only sets the field up with its per column and per row arrays.
+ * Calling polar_field_build_row() until it returns 1 then builds the per
+ * pixel arrays a row at a time, so an image drawn in time slices never
+ * waits for the whole field.
+ */
+const struct polar_field *polar_field_begin(UINT _width, UINT _height,
+                                            UINT _xcenter, UINT _ycenter,
+                                            UINT normalize, int single);
+int polar_field_build_row(int single);
+
+/* Builds the wide distance field of the field last returned, in double or
+ * single precision. Returns 0 if it could not be built, and then must not
+ * be read.
+ */
+int polar_field_widen(UINT margin_x, UINT margin_y, int single);
+
+/* Same as polar_field_widen(), but only sets the wide field up, and then
+ * polar_field_widen_row() builds it a row at a time until it returns 1.
+ * The field must be built completely first.
+ */
+int polar_field_widen_begin(UINT margin_x, UINT margin_y, int single);
+int polar_field_widen_row(int single);
+
+/* Computes distances and angles of row _y from column x0 to x1 the same way
+ * as the per pixel arrays, for images too large to cache them. Columns
+ * around those, up to a multiple of 8 away, may be computed too. The per
+ * column and per row arrays must be set.
+ */
+void polar_field_row(const struct polar_field *f, UINT _y, UINT x0, UINT x1,
+                     double *dist, double *angle);
+/* Same as polar_field_row(), converted like the single precision copies */
+void polar_field_row_float(const struct polar_field *f, UINT _y,
+                           UINT x0, UINT x1, float *dist, float *angle);
+
+/* Sets only the parameters, size and centre of a field, leaving the per
+ * column, row and pixel arrays alone. Used for fields which are not cached.
+ */
+void polar_field_params(struct polar_field *f, UINT _width, UINT _height,
+                        UINT _xcenter, UINT _ycenter, UINT normalize);
+
+#endif /* POLAR_H */
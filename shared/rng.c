@@ -0,0 +1,41 @@
+/* Random number generation for Acid Warp */
+
+#include "rng.h"
+
+struct rng rng_palette;
+struct rng rng_draw;
+
+void rng_init(uint32_t seed)
+{
+  rng_seed(&rng_palette, seed);
+  rng_seed(&rng_draw, seed ^ 0x5BD1E995u);
+}
+
+/* splitmix32 expands the seed into a state which is never all zero */
+void rng_seed(struct rng *r, uint32_t seed)
+{
+  int i;
+
+  for (i = 0; i < 4; ++i) {
+    uint32_t z = (seed += 0x9E3779B9u);
+    z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+    r->s[i] = z ^ (z >> 16);
+  }
+  if (!(r->s[0] | r->s[1] | r->s[2] | r->s[3])) {
+    r->s[0] = 1;
+  }
+}
+
+void rng_fill(struct rng *r, double a, double *out, int n)
+{
+  const double scale = a / 4294967296.0;
+  struct rng s = *r;
+  int i;
+
+  /* Working on a local copy lets the compiler keep the state in registers */
+  for (i = 0; i < n; ++i) {
+    out[i] = rng_next(&s) * scale;
+  }
+  *r = s;
+}
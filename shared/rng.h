@@ -0,0 +1,64 @@
+/* RNG.H */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* Small fast random number generator (xoshiro128**). Unlike rand(), all
+ * state is in the struct, so threads never share or lock anything as long
+ * as each uses its own state.
+ */
+struct rng {
+  uint32_t s[4];
+};
+
+/* States for the two threads which need random numbers outside of image
+ * generation. Only the main thread may use rng_palette, and only the
+ * drawing thread may use rng_draw once it has started.
+ */
+extern struct rng rng_palette;
+extern struct rng rng_draw;
+
+/* Seeds rng_palette and rng_draw */
+void rng_init(uint32_t seed);
+
+/* Seeds a state. Different seeds give unrelated sequences. */
+void rng_seed(struct rng *r, uint32_t seed);
+
+/* Fills out with n values where 0 <= value < a, like rng_double() */
+void rng_fill(struct rng *r, double a, double *out, int n);
+
+static inline uint32_t rng_rotl(uint32_t x, int k)
+{
+  return (x << k) | (x >> (32 - k));
+}
+
+static inline uint32_t rng_next(struct rng *r)
+{
+  uint32_t *s = r->s;
+  const uint32_t result = rng_rotl(s[1] * 5, 7) * 9;
+  const uint32_t t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rng_rotl(s[3], 11);
+  return result;
+}
+
+/* Returns 0 <= result < a, like the old RANDOM() */
+static inline uint32_t rng_below(struct rng *r, uint32_t a)
+{
+  return (uint32_t)(((uint64_t)rng_next(r) * a) >> 32);
+}
+
+/* Returns 0 <= result < a, like the old RANDOMD() */
+static inline double rng_double(struct rng *r, double a)
+{
+  return rng_next(r) * (a / 4294967296.0);
+}
+
+#endif /* RNG_H */
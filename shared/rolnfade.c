@@ -6,6 +6,7 @@
 #include "rolnfade.h"
 #include "palinit.h"
 #include "display.h"
+#include "rng.h"
 
 static int RedRollDirection = 0, GrnRollDirection = 0, BluRollDirection = 0;
 static UINT FadeCompleteFlag = 0;
@@ -103,7 +104,7 @@ static void rolNFadMainPalAry2RndTargNLdDAC(UCHAR *MainPalArray,
                                             UCHAR *TargetPalArray)
 {
 	if (fadePalArrayToTarget (MainPalArray, TargetPalArray) == DONE)
-         initPalArray (TargetPalArray, RANDOM (NUM_PALETTE_TYPES));
+         initPalArray (TargetPalArray, rng_below(&rng_palette, NUM_PALETTE_TYPES));
 
 	maybeInvertSubPalRollDirection();
 	roll_rgb_palArray (  MainPalArray);
@@ -196,7 +197,7 @@ static void roll_rgb_palArray(UCHAR *Pal)
 
 static void maybeInvertSubPalRollDirection(void)
 {
-  switch (RANDOM(DIRECTN_CHANGE_PERIOD_IN_TICKS))
+  switch (rng_below(&rng_palette, DIRECTN_CHANGE_PERIOD_IN_TICKS))
 	{
 		case 0 :
 			RedRollDirection = !RedRollDirection;
@@ -214,10 +215,10 @@ static void maybeInvertSubPalRollDirection(void)
 
 void newPalette(void)
 {
-  paletteTypeNum = RANDOM(NUM_PALETTE_TYPES + 1);
+  paletteTypeNum = rng_below(&rng_palette, NUM_PALETTE_TYPES + 1);
   if (paletteTypeNum >= NUM_PALETTE_TYPES) {
     /* Beginning special morphing palette */
-    initPalArray(TargetPalArray, RANDOM(NUM_PALETTE_TYPES));
+    initPalArray(TargetPalArray, rng_below(&rng_palette, NUM_PALETTE_TYPES));
   } else {
     /* Fading to specific constant palette */
     initPalArray(TargetPalArray, paletteTypeNum);
@@ -241,7 +242,7 @@ void fadeInAndRotate(void)
 
 void beginFadeOut(int toblack)
 {
-  if (toblack || RANDOM(2) == 0) {
+  if (toblack || rng_below(&rng_palette, 2) == 0) {
     fade_dir = 1;
   } else {
     fade_dir = 0;